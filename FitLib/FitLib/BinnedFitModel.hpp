@@ -52,6 +52,23 @@ public:
     /** Map of FitModels in each category */
     std::map<std::string, FitModel*> category_models;
 
+    /** Signal shapes of each production, with their observable */
+    std::vector<std::pair<RooAbsPdf*, RooRealVar*>> signal_shapes;
+
+    /**
+     * PDF to fit to the data of Data::FitData(): a clone with the signal
+     * shapes averaged over the bins if Data::IntegrateBins(), otherwise pdf
+    */
+    RooSimultaneous* fit_pdf = nullptr;
+    RooSimultaneous* FitPdf(){
+        if (!m_data->IntegrateBins()) return pdf.get();
+        if (!fit_pdf){
+            m_log.info("Integrating the signal shapes over the bins");
+            fit_pdf = (RooSimultaneous*) DataUtils::IntegrateBins(*pdf, signal_shapes, m_data->BinPrecision(), "bin_integrated");
+        }
+        return fit_pdf;
+    }
+
     /** Make the signal shapes */
     RooAbsPdf* GetSignalShape(std::string prod, RooDataSet ds, std::string mode){
         RooAbsPdf* signal;
@@ -64,6 +81,8 @@ public:
             if (m_debug){ m_log.debug("Convolving the KDE with Gaussian"); }
             RooRealVar* smear_width = new RooRealVar((prod + "_" + mode + "_smear_width").c_str(), "", 0.003, 1e-4, 0.01);
             RooRealVar* smear_mean = new RooRealVar((prod + "_" + mode + "_smear_mean").c_str(), "", 0, -0.003, 0.003);
+            m_vars->registry.Register(smear_width, ParameterRegistry::Shared, prod, "signal");
+            m_vars->registry.Register(smear_mean, ParameterRegistry::Shared, prod, "signal");
             RooGaussian* smear_fnc = new RooGaussian((prod + "_" + mode + "_smear").c_str(), "", *mass, *smear_mean, *smear_width);
             signal = new RooFFTConvPdf((prod + "_" + mode + "_signal_shape").c_str(), "", *mass, *kde, *smear_fnc);
         }
@@ -79,10 +98,12 @@ public:
         else mass = m_vars->m_kpi;
         if (s.getB("expo_bkgs")){
             RooRealVar* exponent = new RooRealVar(("shared_" + prod + "_" + mode + "_vs_comb_exponent").c_str(), "", -30, -40, 4);
+            m_vars->registry.Register(exponent, ParameterRegistry::Shared, prod, (mode == "kpi") ? "kpi_vs_comb" : "comb_vs_tag", true);
             bkg = new RooExponential(("shared_" + prod + "_" + mode + "_vs_comb_comb_shape").c_str(), "", *mass, *exponent);
         }
         else{
             RooRealVar* exponent = new RooRealVar(("shared_" + prod + "_" + mode + "_vs_comb_exponent").c_str(), "", -0.4, -1.0, 0.2);
+            m_vars->registry.Register(exponent, ParameterRegistry::Shared, prod, (mode == "kpi") ? "kpi_vs_comb" : "comb_vs_tag", true);
             bkg = new RooChebychev(("shared_" + prod + "_" + mode + "_vs_comb_comb_shape").c_str(), "", *mass, *exponent);
         }
         return bkg;
@@ -92,6 +113,8 @@ public:
     RooAbsPdf* GetQQPDF(std::string prod){
         RooRealVar* qqbar_sigma = new RooRealVar(("shared_" + prod + "_qqbar_sigma").c_str(),"", 0.015, 0., 0.180);
         RooRealVar* qqbar_mean = new RooRealVar(("shared_" + prod + "_qqbar_mean").c_str(),"", 3.8, 3.30, 4.20);
+        m_vars->registry.Register(qqbar_sigma, ParameterRegistry::Shared, prod, "correlated_qqbar");
+        m_vars->registry.Register(qqbar_mean, ParameterRegistry::Shared, prod, "correlated_qqbar");
         RooAbsPdf* qqbar = new RooGenericPdf(("shared_" + prod + "_correlated_qqbar").c_str(), "exp(-0.5*pow(((@0+@1)-@3)/@2, 2))", RooArgSet(*m_vars->m_kpi, *m_vars->m_tag, *qqbar_sigma, *qqbar_mean));
         return qqbar;
     }
@@ -117,6 +140,8 @@ public:
             RooAbsPdf* kpi_signal = GetSignalShape(prod, *prod_ds, "kpi");
             RooAbsPdf* tag_signal = GetSignalShape(prod, *prod_ds, "tag");
             RooProdPdf* signal = new RooProdPdf((prod + "_signal").c_str(), "", *kpi_signal, *tag_signal);
+            signal_shapes.push_back({kpi_signal, m_vars->m_kpi});
+            signal_shapes.push_back({tag_signal, m_vars->m_tag});
 
             // Bkg slopes
             RooAbsPdf* kpi_vs_comb_comb_shape;
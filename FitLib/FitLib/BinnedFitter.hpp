@@ -4,9 +4,15 @@
 #include "Settings.hpp"
 #include "Variables.hpp"
 #include "BinnedFitModel.hpp"
+#include "SimultaneousNLL.hpp"
+#include "YieldNLL.hpp"
 #include "Log.hpp"
+#include "FitResultUtils.hpp"
+#include "FitTimer.hpp"
+#include "FitPipeline.hpp"
 
 #include "RooFitResult.h"
+#include "Math/Minimizer.h"
 
 #include <map>
 #include <vector>
@@ -40,6 +46,56 @@ private:
     /** RooFitResult */
     RooFitResult* m_result;
 
+    /** NLL evaluated in worker processes (if nll_workers is set) */
+    std::unique_ptr<SimultaneousNLL> m_nll;
+
+    /** Timing of the fit stages */
+    FitTimer m_timer;
+
+    /** Parameters before the first stage (values, errors and constant flags) */
+    std::unique_ptr<RooArgSet> m_initial_pars;
+
+    /**
+     * Run a fit stage, either on RooFit's NLL or on the per-category NLL
+     * @param pipeline fit pipeline
+     * @param stage stage to run
+     * @param nll_evals set to the number of NLL evaluations of the stage
+    */
+    RooFitResult* Minimise(FitPipeline& pipeline, const FitPipeline::Stage& stage, long& nll_evals);
+
+    /** Default stages: initial fit, second fit if the checks fixed anything, MINOS with the shapes fixed */
+    std::vector<FitPipeline::Stage> DefaultStages();
+
+    /**
+     * Run the checks of a stage and lock the parameters they fix
+     * @param stage stage that has just run
+     * @param pipeline fit pipeline
+    */
+    void RunChecks(const FitPipeline::Stage& stage, FitPipeline& pipeline);
+
+    /** Directory and prename of the output files */
+    std::string OutputPrefix();
+
+    /**
+     * Minuit2 minimiser of the yield NLL, starting from the current parameter values
+     * @param nll NLL with the analytic gradient
+     * @param yields closed-form yields
+    */
+    std::unique_ptr<ROOT::Math::Minimizer> YieldMinimizer(YieldNLL& nll, YieldModel& yields);
+
+    /**
+     * Save the state after a fit stage
+     * @param stage name of the stage
+     * @param r fit result of the stage
+    */
+    void SaveCheckpoint(std::string stage, RooFitResult* r);
+
+    /**
+     * Restore the state saved after a fit stage
+     * @param stage name of the stage
+    */
+    RooFitResult* LoadCheckpoint(std::string stage);
+
 public:
 
     /**
@@ -70,8 +126,25 @@ public:
     /* Write output to file */
     void SaveOutput();
 
-    /* Fix all parameters except signal */
-    void FixAllPars();
+    /* Initialise the parameters, and the covariance of the first fit, from a previous fit */
+    void WarmStart(FitPipeline& pipeline);
+
+    /* Run MINOS for each MINOS variable in its own process */
+    void RunParallelMinos();
+
+    /* Repeat the fit stages unbinned, from the starting values of the binned fit, and compare */
+    void CompareUnbinned();
+
+    /**
+     * Run MIGRAD, HESSE and MINOS of a fixed-shape stage with Minuit2 on the
+     * cached yield NLL and its analytic gradient
+     * @param stage stage to run
+     * @return fit result, or nullptr if the yield NLL can't be used
+    */
+    RooFitResult* FastYieldFit(const FitPipeline::Stage& stage);
+
+    /* Profile the component shapes of each category and write the timing of the fit */
+    void WriteTiming(std::string filename);
 
 };
 
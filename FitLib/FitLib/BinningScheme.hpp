@@ -0,0 +1,106 @@
+#ifndef BINNINGSCHEME_H
+#define BINNINGSCHEME_H
+
+#include "Log.hpp"
+
+#include "TH2.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Dalitz-plot binning scheme read from a 2D bin map, a TH2 of the bin
+ * number in (m^2(KS pi+), m^2(KS pi-)). The map is resampled once onto a
+ * dense uniform grid. Axes with fixed-width bins use the bins of the map as
+ * the grid, with the same index arithmetic as TAxis::FindFixBin. On axes with
+ * variable bins, grid cells lying inside a single bin of the map hold its bin
+ * number and the few cells crossed by a bin edge fall back to the exact lookup.
+*/
+class BinningScheme {
+
+public:
+    /**
+     * Constructor function, reads the bin map and fills the grid
+     * @param filename ROOT file with the bin map
+     * @param histname name of the TH2
+     * @param grid_size number of grid cells along an axis with variable bins
+     * @param signed_map the map holds signed bins; otherwise it holds |bin|,
+     * positive where mMinus > mPlus
+    */
+    BinningScheme(std::string filename, std::string histname, int grid_size = 1024, bool signed_map = true);
+
+    /** Was the bin map read */
+    bool Valid() const { return m_map != nullptr; }
+
+    /**
+     * Bin of one point, 0 outside the map
+     * @param mplus m^2(KS pi+)
+     * @param mminus m^2(KS pi-)
+    */
+    int Bin(double mplus, double mminus) const;
+
+    /**
+     * Bins of many points
+     * @param mplus m^2(KS pi+) of each point
+     * @param mminus m^2(KS pi-) of each point
+     * @param bins output bins
+     * @param n number of points
+    */
+    void Bins(const double* mplus, const double* mminus, int* bins, std::size_t n) const;
+
+private:
+    /** Grid cell value of the cells that need the exact lookup */
+    static const int16_t exact = INT16_MIN;
+
+    /** Exact lookup in the bin map */
+    int ExactBin(double mplus, double mminus) const;
+
+    /** Bin map */
+    std::unique_ptr<TH2> m_map;
+
+    /** Grid axis */
+    struct GridAxis {
+        int n;
+        double min;
+        double max;
+        bool aligned;
+
+        /** Cell of a value, -1 outside the axis */
+        int Cell(double v) const {
+            if (v < min || !(v < max)) return -1;
+            return std::min(n - 1, (int) (n * (v - min) / (max - min)));
+        }
+    };
+
+    /**
+     * Grid along an axis of the map
+     * @param axis axis of the map
+     * @param grid_size number of cells if the axis has variable bins
+    */
+    static GridAxis MakeGridAxis(const TAxis* axis, int grid_size);
+
+    /**
+     * Does a grid cell lie inside one bin of an axis of the map
+     * @param grid grid axis
+     * @param axis axis of the map
+     * @param cell grid cell
+     * @return bin of the map, -1 if the cell crosses a bin edge
+    */
+    static int CellBin(const GridAxis& grid, const TAxis* axis, int cell);
+
+    /** Grid, row-major in mMinus */
+    std::vector<int16_t> m_grid;
+    GridAxis m_x, m_y;
+
+    /** The map holds signed bins */
+    bool m_signed;
+
+    /** Logging class */
+    Log m_log;
+
+};
+
+#endif //  BinningScheme_H
@@ -6,6 +6,8 @@
 #include "Selection.hpp"
 #include "Log.hpp"
 #include "DataUtils.hpp"
+#include "MCMatrices.hpp"
+#include "BinningScheme.hpp"
 
 #include "RooDataSet.h"
 
@@ -43,6 +45,9 @@ private:
     /** Variables class */
     Variables* m_vars;
 
+    /** Alternative DP binning, if binning_scheme is set */
+    std::unique_ptr<BinningScheme> m_binning;
+
     /**
     * Function to load in an MC TChain
     * @param sample name of the sample
@@ -51,6 +56,31 @@ private:
     */
     std::unique_ptr<TChain> LoadMCChain(TString sample, bool bkg_prod, bool bkg_decay);
 
+    /** Read the binning scheme named by binning_scheme */
+    void LoadBinningScheme();
+
+    /**
+    * Flavour-corrected DP bin of each candidate, as in Selection::BinCut,
+    * from the binning scheme if there is one, otherwise from the tuple
+    * @param ds KSPiPi dataset
+    */
+    std::vector<int> DalitzBins(RooDataSet& ds);
+
+    /** Threads used to derive the efficiency matrices from the MC, mc_matrix_threads (default 1) */
+    int MCMatrixThreads(){ return m_settings.key_exists("mc_matrix_threads") ? m_settings.getI("mc_matrix_threads") : 1; }
+
+    /**
+    * Use the migration matrix derived from the signal MC in place of the file
+    * @param counts MC candidates in each pair of reconstructed and true DP bins
+    */
+    void UseMCMigration(const MCMatrices::MigrationCounts& counts);
+
+    /**
+    * Use the unfolding matrices of the tag derived from the signal MC in
+    * place of the files, writing them to mc_unfolding_folder if it is set
+    */
+    void UseMCUnfolding();
+
 
 public:
     /**
@@ -61,6 +91,13 @@ public:
     std::unique_ptr<RooDataSet> bkg_mc;
     std::unique_ptr<RooDataSet> other_prod_mc;
     std::map<std::string, std::unique_ptr<RooDataSet>> shapes;
+    std::unique_ptr<RooDataHist> binned_data;
+
+    /** Migration matrix derived from the signal MC, if mc_migration is set */
+    std::unique_ptr<MCMatrices::MatrixWithErrors> mc_migration;
+
+    /** Unfolding matrices derived from the signal MC by file name, if mc_unfolding is set */
+    std::map<std::string, MCMatrices::MatrixWithErrors> mc_unfolding;
 
     /** Name of prod */
     TString m_prod;
@@ -79,22 +116,31 @@ public:
         m_debug = debug;
         Initialise(); 
 
+        if (m_settings.key_exists("mc_unfolding") && m_settings.getB("mc_unfolding")) UseMCUnfolding();
+
         if (m_settings.get("tag") == "KSPiPi"){
+            if (m_settings.key_exists("binning_scheme")) LoadBinningScheme();
             std::map<std::string, RooDataSet*> data_map, mc_map;
+            bool derive_migration = m_settings.key_exists("mc_migration") && m_settings.getB("mc_migration");
+            MCMatrices::MigrationCounts migration_counts;
             for (auto prod: Definitions::PRODS){
                 m_prod = prod;
                 std::unique_ptr<RooDataSet> ds = std::move(LoadData());
                 std::unique_ptr<RooDataSet> mc_ds = std::move(LoadSignalMC());
+                if (derive_migration) migration_counts += MCMatrices::CountMigration(*mc_ds, m_vars, MCMatrixThreads());
+                auto data_parts = DataUtils::PartitionDataset(*ds, DalitzBins(*ds), Definitions::DP_BINS);
+                auto mc_parts = DataUtils::PartitionDataset(*mc_ds, DalitzBins(*mc_ds), Definitions::DP_BINS);
                 for (int bin: Definitions::DP_BINS){
                     auto cat_label = Definitions::ProdBinLabel(prod, bin);
-                    data_map[cat_label] = static_cast<RooDataSet*>(ds->reduce(Selection::BinCut(bin)));
-                    mc_map[cat_label] = static_cast<RooDataSet*>(mc_ds->reduce(Selection::BinCut(bin)));
+                    data_map[cat_label] = data_parts[bin];
+                    mc_map[cat_label] = mc_parts[bin];
                 }
             }
             data = std::make_unique<RooDataSet>("comb_data", "", RooArgSet(*m_vars->m_kpi, *m_vars->m_tag), RooFit::Index(*m_vars->cats), RooFit::Import(data_map));
             signal_mc = std::make_unique<RooDataSet>("comb_mc", "", RooArgSet(*m_vars->m_kpi, *m_vars->m_tag), RooFit::Index(*m_vars->cats), RooFit::Import(mc_map));
             DataUtils::ClearMap(data_map);
             DataUtils::ClearMap(mc_map);
+            if (derive_migration) UseMCMigration(migration_counts);
         }
         else{
             data = std::move(LoadData());
@@ -106,6 +152,15 @@ public:
 
     }
 
+    /**
+    Constructor function, selects the samples of this configuration from
+    the uncut samples already loaded by another Data class
+    * @param settings fit config
+    * @param vars Class storing all of the variables
+    * @param sample Data class loaded without cuts
+    */
+    Data(Settings settings, Variables* vars, Data* sample, bool debug = false);
+
     /** Initialise class variables */
     void Initialise(){
         m_log = Log("Data");
@@ -117,6 +172,11 @@ public:
     /**
     * Load the MC samples
     */
+    std::vector<std::string> SignalMCFiles(){
+        std::vector<std::string> files;
+        for (TString sample: {"D0D0_40x_combined", "DST0D0_40x_combined", "DST0DST0_40x_combined"}) files.push_back((m_base_path + "signal/" + sample + ".root").Data());
+        return files;
+    }
     std::unique_ptr<RooDataSet> LoadSignalMC(){
         std::unique_ptr<RooDataSet> all_mc;
         std::unique_ptr<RooDataSet> dd_mc = LoadMCSample("D0D0_40x_combined", false, false, 1./40);
@@ -145,6 +205,25 @@ public:
     */
     void TruthMatchComponents();
 
+    /**
+     * Dataset to fit: the data binned in (m_kpi, m_tag) if binned_fit
+     * is set (binned_fit_nbins bins per axis), otherwise the unbinned data.
+     * RooFit evaluates the PDFs at the bin centres of the 2D bins, unless the
+     * models integrate their signal shapes over the bins (IntegrateBins).
+    */
+    RooAbsData* FitData();
+
+    /**
+     * Should the models average their signal shapes over the bins of FitData()
+     * (binned_fit_integrate) rather than evaluate them at the bin centres
+    */
+    bool IntegrateBins();
+
+    /**
+     * Precision of the integration over the bins, binned_fit_precision (default 1e-3)
+    */
+    double BinPrecision();
+
     /**
     * Function to load in an MC RooDataSet
     * @param sample name of the sample
@@ -2,11 +2,18 @@
 #define DATAUTILS_H
 
 #include "RooDataSet.h"
+#include "RooDataHist.h"
+#include "RooAbsPdf.h"
+#include "RooRealVar.h"
 #include "TTree.h"
 #include "TFile.h"
 #include "TString.h"
 
+#include <map>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 /**
  * Namespace containing utility functions to perform on datasets
@@ -28,6 +35,45 @@ namespace DataUtils {
     */
     void SaveDatasetToFile(RooDataSet dataset, TString filename, TString treename);
 
+    /**
+     * Fill a RooDataHist from a dataset, with a named uniform binning
+     * so the default binning of the observables is left unchanged
+     * @param ds RooDataSet to be binned
+     * @param observables observables (and index categories) of the histogram
+     * @param nbins number of bins of each continuous observable
+    */
+    std::unique_ptr<RooDataHist> BinDataset(RooDataSet& ds, RooArgSet observables, int nbins);
+
+    /**
+     * Clone of a PDF in which some 1D shapes are averaged over the bins of their
+     * observable (RooBinSamplingPdf) instead of evaluated at the bin centres.
+     * RooFit::IntegrateBins only wraps 1D PDFs, so this is how the factors of a
+     * 2D product are integrated. RooBinSamplingPdf uses the default binning, so
+     * the binned_fit binning (see BinDataset) becomes the default binning of the
+     * observables. The parameters are shared with the original PDF.
+     * @param pdf PDF to clone
+     * @param shapes shapes to integrate, each with its observable
+     * @param precision precision of the integration over each bin
+     * @param name suffix of the cloned nodes
+    */
+    RooAbsPdf* IntegrateBins(RooAbsPdf& pdf, const std::vector<std::pair<RooAbsPdf*, RooRealVar*>>& shapes, double precision, std::string name);
+
+    /**
+     * Values of a variable of a dataset, read in one pass
+     * @param ds RooDataSet to read
+     * @param name name of the variable
+    */
+    std::vector<double> GetColumn(RooDataSet& ds, TString name);
+
+    /**
+     * Split a dataset by an integer key in one pass, in place of a reduce per key
+     * @param ds RooDataSet to split
+     * @param keys key of each entry
+     * @param values keys to keep, entries with other keys are dropped
+     * @return dataset of each key, owned by the caller
+    */
+    std::map<int, RooDataSet*> PartitionDataset(RooDataSet& ds, const std::vector<int>& keys, const std::vector<int>& values);
+
     /**
      * Delete pointers in a map to remove memory leaks
      * @param m map of strings and RooDataSets
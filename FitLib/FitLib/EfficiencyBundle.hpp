@@ -0,0 +1,108 @@
+#ifndef EFFICIENCYBUNDLE_H
+#define EFFICIENCYBUNDLE_H
+
+#include "Log.hpp"
+
+#include "TMatrixD.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Read-only view of a binary bundle of efficiency and migration matrices,
+ * mapped into memory with a single mmap. Matrices are looked up by the
+ * name of the file they were packed from (e.g. KK_vs_KPi.txt) or by
+ * "migMatrix" for the migration matrix. The bundle records the folder and
+ * the migration file it was packed from, so the matrices are only used for
+ * that folder and file.
+ *
+ * Layout (native byte order), version 2:
+ *   header:  char magic[8] "DTFEFFB", uint32 version, uint32 nmatrices, uint64 index offset
+ *   data:    row-major doubles of each matrix, already scaled as they are used
+ *   index:   per matrix uint32 rows, uint32 cols, uint64 data offset, uint32 name length, name
+ *   sources: uint32 length, folder, uint32 length, migration file (canonical paths)
+*/
+class EfficiencyBundle {
+
+public:
+    /** Version written by Write and accepted by the reader */
+    static const uint32_t version = 2;
+
+    /**
+     * Constructor function, maps the bundle and reads its index
+     * @param filename bundle file
+    */
+    EfficiencyBundle(std::string filename);
+
+    /** Deconstructor function, unmaps the bundle */
+    ~EfficiencyBundle();
+
+    EfficiencyBundle(const EfficiencyBundle&) = delete;
+    EfficiencyBundle& operator=(const EfficiencyBundle&) = delete;
+
+    /** Was the bundle mapped and its index valid */
+    bool Valid() const { return m_valid; }
+
+    /** Number of matrices */
+    int Size() const { return m_index.size(); }
+
+    /** Canonical path of the efficiency folder the bundle was packed from */
+    const std::string& Folder() const { return m_folder; }
+
+    /** Canonical path of the migration file the bundle was packed from */
+    const std::string& MigrationFile() const { return m_migration_file; }
+
+    /**
+     * Canonical path of a file or folder, as stored in the bundle
+     * @param path path to resolve (returned unchanged if it doesn't exist)
+    */
+    static std::string CanonicalPath(std::string path);
+
+    /**
+     * Copy a matrix out of the bundle
+     * @param name name of the matrix
+     * @param m output matrix, resized to the stored shape
+     * @return whether the matrix is in the bundle
+    */
+    bool Get(std::string name, TMatrixD& m) const;
+
+    /**
+     * Write a bundle
+     * @param filename output file
+     * @param matrices matrices with their names
+     * @param folder efficiency folder the unfolding matrices were read from
+     * @param migration_file file the migration matrix was read from
+    */
+    static bool Write(std::string filename, const std::vector<std::pair<std::string, TMatrixD>>& matrices, std::string folder, std::string migration_file);
+
+private:
+    /** Location of a matrix in the mapping */
+    struct Entry {
+        uint32_t rows;
+        uint32_t cols;
+        const double* data;
+    };
+
+    /** Mapped file */
+    void* m_map = nullptr;
+    std::size_t m_size = 0;
+
+    /** Index by name */
+    std::map<std::string, Entry> m_index;
+
+    /** Sources of the matrices */
+    std::string m_folder;
+    std::string m_migration_file;
+
+    /** Was the bundle read */
+    bool m_valid = false;
+
+    /** Logging class */
+    Log m_log;
+
+};
+
+#endif //  EfficiencyBundle_H
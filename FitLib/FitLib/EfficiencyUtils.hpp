@@ -2,10 +2,15 @@
 #define EFFICIENCYUTILS_H
 
 #include "Settings.hpp"
+#include "FixedMatrix.hpp"
+#include "EfficiencyBundle.hpp"
 
 #include "TMatrixD.h"
 #include "TVectorD.h"
 #include <map>
+#include <memory>
+#include <string>
+#include <tuple>
 
 namespace EfficiencyUtils {
 
@@ -14,9 +19,109 @@ namespace EfficiencyUtils {
     const int nbins = 16;
     const int nprods = 5;
 
+    /**
+     * Key of a cached matrix
+     * kind: "migration" or "unfolding"
+     * tag: CP tag, or |bin| of the KSpipi DP region
+     * folder: efficiency folder, ender: systematic file ender, seed: toy seed (-1 if not a toy)
+     * bundle: efficiency bundle the matrix is read from ("" for the text and ROOT files)
+    */
+    struct MatrixKey {
+        std::string kind;
+        std::string tag;
+        std::string folder;
+        std::string ender;
+        int seed;
+        std::string bundle;
+        bool operator<(const MatrixKey& other) const {
+            return std::tie(kind, tag, folder, ender, seed, bundle) < std::tie(other.kind, other.tag, other.folder, other.ender, other.seed, other.bundle);
+        }
+    };
+
+    /** Fixed-size vectors and matrices of the efficiency maths */
+    using ProdVector = FixedMatrix::Vector<nprods>;
+    using BinVector = FixedMatrix::Vector<nbins>;
+    using ProdMatrix = FixedMatrix::Matrix<nprods, nprods>;
+    using BinMatrix = FixedMatrix::Matrix<nbins, nbins>;
+
+    /**
+     * Cached N x N matrix with its LU decomposition
+    */
+    template <int N>
+    struct CachedMatrix {
+        FixedMatrix::Matrix<N, N> matrix;
+        FixedMatrix::LU<N> lu;
+        CachedMatrix(const TMatrixD& m) : matrix(FixedMatrix::Matrix<N, N>::FromTMatrix(m)), lu(matrix) {}
+
+        /** Matrix times yields */
+        FixedMatrix::Vector<N> Fold(const FixedMatrix::Vector<N>& yields) const { return matrix * yields; }
+
+        /** Inverse matrix times yields, from the LU decomposition */
+        FixedMatrix::Vector<N> Unfold(const FixedMatrix::Vector<N>& yields) const { return lu.Solve(yields); }
+    };
+    using CachedMigration = CachedMatrix<nbins>;
+    using CachedUnfolding = CachedMatrix<nprods>;
+
+    /**
+     * Read an unfolding matrix from a text file (percentages)
+     * @param filename name of the file
+    */
+    TMatrixD ReadUnfoldingFile(std::string filename);
+
+    /**
+     * Read the migration matrix from the migMatrix histogram of a ROOT file
+     * @param filename name of the file
+    */
+    TMatrixD ReadMigrationFile(std::string filename);
+
+    /** ROOT file with the migration matrix */
+    const std::string migration_file = "/home/mackay/bes3_deltaKPi/misc/migration/new_single_migration_matrices.root";
+
+    /**
+     * Efficiency bundle named by the efficiency_bundle setting, mapped once per process
+     * @return the bundle, null if the setting is absent or the bundle can't be read
+    */
+    std::shared_ptr<const EfficiencyBundle> GetBundle(Settings s);
+
+    /**
+     * Matrices from the process-wide cache. Each matrix is read and decomposed
+     * once, from the efficiency bundle if there is one and it has the matrix,
+     * otherwise from its file; later calls, from any thread, share the cached copy.
+     * @param bin index of KSpipi DP region
+     * @param tag name of CP tag
+    */
+    std::shared_ptr<const CachedMigration> CachedMigrationMatrix(Settings s = Settings());
+    std::shared_ptr<const CachedUnfolding> CachedUnfoldingMatrix(int bin, Settings s);
+    std::shared_ptr<const CachedUnfolding> CachedUnfoldingMatrix(std::string tag, Settings s);
+
+    /**
+     * Use this migration matrix in place of the file for the rest of the process
+     * (or until ClearMatrixCache), e.g. one derived from the signal MC
+     * @param m migration matrix, [reco bin][true bin]
+    */
+    void SetMigrationMatrix(const TMatrixD& m);
+
+    /**
+     * Use this unfolding matrix in place of its file for the rest of the process
+     * (or until ClearMatrixCache). Only the nominal matrices can be replaced.
+     * @param folder folder of the file, see UnfoldingFolder
+     * @param name name of the file, e.g. KK_vs_KPi.txt or KSPiPi_vs_KPiFTbin1.txt
+     * @param m unfolding matrix, as a fraction
+    */
+    void SetUnfoldingMatrix(std::string folder, std::string name, const TMatrixD& m);
+
+    /**
+     * Folder of the unfolding matrices, from efficiency_folder
+     * @param kspipi folder of the KSpipi DP regions (a path) or of the CP tags (a name in input_dir)
+    */
+    std::string UnfoldingFolder(Settings s, bool kspipi);
+
+    /** Empty the matrix cache, e.g. after the input files have changed */
+    void ClearMatrixCache();
+
     /** Function to load the KSpipi migration matrix */
-    TMatrixD GetMigrationMatrix();
-    inline TMatrixD GetInverseMigrationMatrix(){ return GetMigrationMatrix().Invert(); }
+    inline TMatrixD GetMigrationMatrix(Settings s = Settings()){ return CachedMigrationMatrix(s)->matrix.ToTMatrix(); }
+    inline TMatrixD GetInverseMigrationMatrix(Settings s = Settings()){ return CachedMigrationMatrix(s)->lu.Inverse().ToTMatrix(); }
 
     /**
      * Function to perform the KSpipi bin migration
@@ -30,10 +135,10 @@ namespace EfficiencyUtils {
      * @param bin index of KSpipi DP region
      * @param tag name of CP tag
     */
-    TMatrixD GetUnfoldingMatrix(int bin, Settings s);
-    TMatrixD GetUnfoldingMatrix(std::string tag, Settings s);
-    inline TMatrixD GetInverseUnfoldingMatrix(int bin, Settings s){ return GetUnfoldingMatrix(abs(bin), s).Invert(); }
-    inline TMatrixD GetInverseUnfoldingMatrix(std::string tag, Settings s){ return GetUnfoldingMatrix(tag, s).Invert(); }
+    inline TMatrixD GetUnfoldingMatrix(int bin, Settings s){ return CachedUnfoldingMatrix(bin, s)->matrix.ToTMatrix(); }
+    inline TMatrixD GetUnfoldingMatrix(std::string tag, Settings s){ return CachedUnfoldingMatrix(tag, s)->matrix.ToTMatrix(); }
+    inline TMatrixD GetInverseUnfoldingMatrix(int bin, Settings s){ return CachedUnfoldingMatrix(bin, s)->lu.Inverse().ToTMatrix(); }
+    inline TMatrixD GetInverseUnfoldingMatrix(std::string tag, Settings s){ return CachedUnfoldingMatrix(tag, s)->lu.Inverse().ToTMatrix(); }
 
     /** 
      * Return row of efficiency matrix
@@ -42,8 +147,8 @@ namespace EfficiencyUtils {
     */
     inline TVectorD GetRowOfUnfoldingMatrix(std::string tag, int row_index, Settings s){
         TVectorD row(EfficiencyUtils::nprods);
-        TMatrixD m = GetUnfoldingMatrix(tag, s);
-        row = TMatrixDRow(m, row_index);
+        auto unfolding = CachedUnfoldingMatrix(tag, s);
+        for (int j=0; j<EfficiencyUtils::nprods; j++) row(j) = unfolding->matrix(row_index, j);
         return row;
     }
 
@@ -58,6 +163,14 @@ namespace EfficiencyUtils {
     TVectorD FoldYields(TVectorD yields_by_prod, std::string tag, Settings s);
     TVectorD UnfoldYields(TVectorD yields_by_prod, std::string tag, Settings s);
 
+    /**
+     * Perform efficiency calculation without allocating
+     * @param yields_by_prod yields by production mechanism
+     * @param bin index of KSpipi DP region
+    */
+    inline ProdVector FoldYields(const ProdVector& yields_by_prod, int bin, Settings s){ return CachedUnfoldingMatrix(abs(bin), s)->Fold(yields_by_prod); }
+    inline ProdVector UnfoldYields(const ProdVector& yields_by_prod, int bin, Settings s){ return CachedUnfoldingMatrix(abs(bin), s)->Unfold(yields_by_prod); }
+
 }
 
 #endif //  Efficiencies_H
@@ -36,6 +36,18 @@ private:
     /* Category name (for binned fits) */
     std::string m_cat_name;
 
+    /**
+     * Register a parameter of this category in the parameter registry
+     * @param var parameter
+     * @param role role of the parameter
+     * @param component name of the component
+     * @param slope is it a background slope
+    */
+    void Register(RooRealVar* var, ParameterRegistry::Role role, std::string component, bool slope = false){
+        m_vars->registry.Register(var, role, m_cat_name, component, slope);
+        return;
+    }
+
 public:
     /**
     * Constructor
@@ -103,6 +115,20 @@ public:
         return;
     }
 
+    /**
+     * PDF to fit to the data of Data::FitData(): a clone with the signal
+     * shapes averaged over the bins if Data::IntegrateBins(), otherwise pdf
+    */
+    RooAbsPdf* fit_pdf = nullptr;
+    RooAbsPdf* FitPdf(){
+        if (!m_data->IntegrateBins()) return pdf.get();
+        if (!fit_pdf){
+            if (m_debug) m_log.info("Integrating the signal shapes over the bins");
+            fit_pdf = DataUtils::IntegrateBins(*pdf, {{kpi_signal_shape, m_vars->m_kpi}, {tag_signal_shape, m_vars->m_tag}}, m_data->BinPrecision(), "bin_integrated");
+        }
+        return fit_pdf;
+    }
+
     /**
      * Add the components to the PDF
     */
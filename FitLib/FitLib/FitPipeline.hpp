@@ -0,0 +1,161 @@
+#ifndef FITPIPELINE_H
+#define FITPIPELINE_H
+
+#include "Settings.hpp"
+#include "Variables.hpp"
+#include "ParameterRegistry.hpp"
+#include "Log.hpp"
+
+#include "RooAbsData.h"
+#include "RooAbsPdf.h"
+#include "RooFitResult.h"
+#include "TMatrixDSym.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * Sequence of fit stages read from the settings. Each stage sets the
+ * minimiser, the strategy, the number of CPUs, which parameter roles
+ * float, whether MINOS runs, the checks run after it and when it is
+ * skipped. Every key is optional and falls back to the default stages
+ * of the fitter, so an empty config reproduces the usual sequence:
+ *   fit_stages initial, second, minos
+ *   stage_<name>_minimizer Minuit2, migrad   (type and algorithm)
+ *   stage_<name>_strategy 1
+ *   stage_<name>_ncpu 6
+ *   stage_<name>_float all                   (or yield, shape, shared, physics, nuisance)
+ *   stage_<name>_minos true
+ *   stage_<name>_checks yields, slopes
+ *   stage_<name>_skip_if unchanged           (no parameter was fixed since the last fit)
+ * Parameters that are constant when the pipeline is made, or that a check
+ * fixes, never float again.
+*/
+class FitPipeline {
+
+public:
+    /**
+     * Definition of a stage
+    */
+    struct Stage {
+        std::string name;
+        std::string minimizer = "";
+        std::string algorithm = "";
+        int strategy = -1;
+        int ncpu = 1;
+        std::vector<ParameterRegistry::Role> floating = {ParameterRegistry::Yield, ParameterRegistry::Shape, ParameterRegistry::Shared, ParameterRegistry::Physics, ParameterRegistry::Nuisance};
+        bool minos = false;
+        std::vector<std::string> checks;
+        std::string skip_if = "";
+    };
+
+    /**
+     * Constructor function, reads the stages and locks the constant parameters
+     * @param settings fit config
+     * @param vars Class storing all of the variables
+     * @param defaults default stages of the fitter
+    */
+    FitPipeline(Settings settings, Variables* vars, std::vector<Stage> defaults, bool debug = false);
+
+    /** Stages, in order */
+    const std::vector<Stage>& Stages() const { return m_stages; }
+
+    /** Index of a stage, -1 if there is no such stage */
+    int Find(std::string name) const;
+
+    /** Should the stage be skipped */
+    bool Skip(const Stage& stage) const;
+
+    /** Does the stage only float the parameters of interest */
+    bool FixedShape(const Stage& stage) const;
+
+    /** Fix and float the parameters for a stage */
+    void Prepare(const Stage& stage);
+
+    /** A minimisation has run */
+    void Finish(){ m_changed = false; }
+
+    /**
+     * Lock the parameters that the checks fixed
+     * @return whether any parameter was fixed
+    */
+    bool Update();
+
+    /**
+     * Seed the next minimisation with the covariance of a previous fit. Minuit2
+     * then starts MIGRAD from this matrix instead of building one by finite
+     * differences; parameters the previous fit did not float get their step size.
+     * @param names floated parameters of the previous fit
+     * @param covariance their covariance matrix
+    */
+    void SeedCovariance(const std::vector<std::string>& names, const TMatrixDSym& covariance);
+
+    /**
+     * Run a stage on the extended NLL of a PDF, as fitTo would
+     * @param pdf PDF to fit
+     * @param data data to fit
+     * @param stage stage to run
+     * @param minos run MINOS (if the stage asks for it)
+     * @param nll_evals set to the number of NLL evaluations
+    */
+    RooFitResult* Fit(RooAbsPdf& pdf, RooAbsData& data, const Stage& stage, bool minos, long& nll_evals);
+
+    /**
+     * Run a stage on an NLL: MIGRAD (or the stage minimiser), HESSE and MINOS
+     * @param nll NLL to minimise
+     * @param stage stage to run
+     * @param minos run MINOS (if the stage asks for it)
+     * @param nll_evals set to the number of NLL evaluations
+    */
+    RooFitResult* Minimise(RooAbsReal& nll, const Stage& stage, bool minos, long& nll_evals);
+
+private:
+    /** Fit configuration class */
+    Settings m_settings;
+
+    /** Variables class */
+    Variables* m_vars;
+
+    /** Debug flag */
+    bool m_debug;
+
+    /** Logging class */
+    Log m_log;
+
+    /** Stages */
+    std::vector<Stage> m_stages;
+
+    /** Parameters that never float */
+    std::set<RooRealVar*> m_locked;
+
+    /** Parameters floated by the last stage */
+    std::vector<RooRealVar*> m_floated;
+
+    /** Has a parameter been fixed since the last minimisation */
+    bool m_changed = true;
+
+    /** Parameters and covariance seeding the next minimisation */
+    std::vector<std::string> m_seed_names;
+    TMatrixDSym m_seed_covariance;
+
+    /**
+     * Read the keys of a stage
+     * @param stage stage with its default values
+    */
+    void ReadStage(Stage& stage);
+
+    /**
+     * Run a stage with Minuit2 directly, seeded with m_seed_covariance,
+     * since RooMinimizer creates its Minuit2 instance inside each call and
+     * offers no way to pass it a covariance matrix
+     * @param nll NLL to minimise
+     * @param stage stage to run
+     * @param minos run MINOS (if the stage asks for it)
+     * @param nll_evals set to the number of NLL evaluations
+    */
+    RooFitResult* SeededMinimise(RooAbsReal& nll, const Stage& stage, bool minos, long& nll_evals);
+
+};
+
+#endif //  FitPipeline_H
@@ -0,0 +1,122 @@
+#ifndef FITRESULTUTILS_H
+#define FITRESULTUTILS_H
+
+#include "RooArgSet.h"
+#include "RooFitResult.h"
+#include "TMatrixDSym.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Namespace containing utility functions to store and reload fit results
+*/
+namespace FitResultUtils {
+
+    /**
+     * Value and errors of a parameter from a previous fit
+    */
+    struct ParameterState {
+        double value = 0;
+        double error_lo = 0;
+        double error_hi = 0;
+        double error = 0;
+    };
+
+    /**
+     * Read the floated parameters of a fit_results.txt file
+     * @param filename name of the text file
+    */
+    std::map<std::string, ParameterState> ReadTextResults(std::string filename);
+
+    /**
+     * Read the floated parameters of a RooFitResult saved with WriteBinaryResults
+     * @param filename name of the ROOT file
+    */
+    std::map<std::string, ParameterState> ReadBinaryResults(std::string filename);
+
+    /**
+     * Read the covariance matrix of the floated parameters of a RooFitResult
+     * saved with WriteBinaryResults (text results have no covariance)
+     * @param filename name of the ROOT file
+     * @param names set to the names of the floated parameters
+     * @param covariance set to their covariance matrix
+     * @return whether a covariance matrix was read
+    */
+    bool ReadCovariance(std::string filename, std::vector<std::string>& names, TMatrixDSym& covariance);
+
+    /**
+     * Read a parameter snapshot, text or binary depending on the file extension
+     * @param filename name of the file
+    */
+    std::map<std::string, ParameterState> ReadSnapshot(std::string filename);
+
+    /**
+     * Set the values and step sizes of the floating parameters, matched by name
+     * @param pars parameters of the PDF
+     * @param snapshot parameter states
+     * @return number of parameters that were set
+    */
+    int ApplySnapshot(const RooArgSet& pars, const std::map<std::string, ParameterState>& snapshot);
+
+    /**
+     * Save a RooFitResult in a ROOT file
+     * @param result fit result
+     * @param filename name of the output file
+    */
+    void WriteBinaryResults(RooFitResult* result, std::string filename);
+
+    /**
+     * Save the fit result and the state of the parameters (values, errors and constant flags)
+     * @param result fit result of the stage
+     * @param pars parameters of the PDF
+     * @param filename name of the checkpoint file
+    */
+    void WriteCheckpoint(RooFitResult* result, const RooArgSet& pars, std::string filename);
+
+    /**
+     * Restore the parameters from a checkpoint and return the saved fit result
+     * @param pars parameters of the PDF
+     * @param filename name of the checkpoint file
+    */
+    RooFitResult* ReadCheckpoint(const RooArgSet& pars, std::string filename);
+
+    /**
+     * Set the values, errors and constant flags of the parameters from a snapshot
+     * @param pars parameters of the PDF
+     * @param state snapshot of the parameters
+    */
+    void RestoreParameters(const RooArgSet& pars, const RooArgSet& state);
+
+    /**
+     * Write the floated parameters of a binned and an unbinned fit side by side,
+     * with the difference in units of the unbinned error. Unless the binned
+     * fit integrated the signal shapes over the bins, it evaluates the PDFs at
+     * the bin centres, so this includes that bias.
+     * @param binned fit result of the binned fit
+     * @param unbinned fit result of the unbinned fit
+     * @param integrated were the signal shapes integrated over the bins
+     * @param filename name of the output text file
+    */
+    void WriteComparison(RooFitResult* binned, RooFitResult* unbinned, bool integrated, std::string filename);
+
+    /**
+     * Build a RooFitResult from a minimisation done outside RooFit
+     * @param name name of the fit result
+     * @param init_pars floating parameters before the fit
+     * @param final_pars floating parameters after the fit, with their errors
+     * @param const_pars constant parameters
+     * @param min_nll minimum of the NLL
+     * @param edm estimated distance to the minimum
+     * @param status fit status
+     * @param cov_qual quality of the covariance matrix
+     * @param covariance covariance matrix of the floating parameters
+     * @param history status of each minimisation step
+    */
+    RooFitResult* MakeFitResult(std::string name, const RooArgList& init_pars, const RooArgList& final_pars, const RooArgList& const_pars, double min_nll, double edm, int status, int cov_qual, TMatrixDSym covariance, const std::vector<std::pair<std::string, int>>& history);
+
+}
+
+#endif //  FitResultUtils_H
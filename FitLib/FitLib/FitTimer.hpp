@@ -0,0 +1,112 @@
+#ifndef FITTIMER_H
+#define FITTIMER_H
+
+#include "Log.hpp"
+
+#include "RooAbsData.h"
+#include "RooAbsPdf.h"
+#include "RooFitResult.h"
+
+#include <chrono>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Class to record where the time of a fit goes. Each fit stage is timed
+ * (wall and CPU time of this process) and its MIGRAD/HESSE/MINOS calls are
+ * read from the status history of its fit result. Every stage counts its
+ * own NLL evaluations, from the minimiser or from our own NLLs (YieldNLL),
+ * and separately those of the stages nested in it. The time of
+ * each category is measured during the fit when it is evaluated per
+ * category (SimultaneousNLL); the cost of each component shape is one pass
+ * over the data after the fit, so the slow KDE or convolution can be found.
+ * Written as "key value" lines.
+*/
+class FitTimer {
+
+private:
+    /** Details of a timed stage */
+    struct Stage {
+        std::string name;
+        double wall;
+        double cpu;
+        int migrad;
+        int hesse;
+        int minos;
+        long nll_evals;
+        long nested_evals;
+        double nested_wall;
+    };
+
+    /** Timed stages, in order */
+    std::vector<Stage> m_stages;
+
+    /** Start of a running stage */
+    struct Running {
+        std::string name;
+        std::chrono::steady_clock::time_point wall;
+        std::clock_t cpu;
+        long nll_evals;
+        long nested_evals;
+        double nested_wall;
+    };
+
+    /** Running stages; stages can be nested (e.g. the fast yield fit inside a stage) */
+    std::vector<Running> m_running;
+
+    /** Category NLL time and number of evaluations */
+    std::vector<std::pair<std::string, double>> m_categories;
+    long m_category_evals = 0;
+
+    /** Time of one pass of each component over its data, and the number of entries */
+    std::vector<std::pair<std::string, std::pair<double, int>>> m_components;
+
+    /** Logging class */
+    Log m_log;
+
+public:
+    /** Constructor function */
+    FitTimer(){ m_log = Log("FitTimer"); }
+
+    /**
+     * Start timing a stage
+     * @param stage name of the stage
+     * @param nll_evals NLL evaluation counter at the start (-1 if not counted)
+    */
+    void Start(std::string stage, long nll_evals = -1);
+
+    /**
+     * Stop timing the innermost running stage
+     * @param r fit result of the stage, for the MIGRAD/HESSE/MINOS calls (can be null)
+     * @param nll_evals NLL evaluation counter at the end (-1 if not counted);
+     * the evaluations of the stage are also added to the stage it is nested in
+    */
+    void Stop(RooFitResult* r = nullptr, long nll_evals = -1);
+
+    /**
+     * Set the NLL time of each category
+     * @param labels category labels
+     * @param costs total evaluation time of each category (seconds)
+     * @param nevals number of evaluations
+    */
+    void SetCategoryCosts(const std::vector<std::string>& labels, const std::vector<double>& costs, long nevals);
+
+    /**
+     * Time one pass of each component shape over the data of its category
+     * @param category category label ("" if not simultaneous)
+     * @param shapes component shapes by name
+     * @param data data of the category
+    */
+    void ProfileComponents(std::string category, const std::map<std::string, RooAbsPdf*>& shapes, RooAbsData& data);
+
+    /**
+     * Write the report
+     * @param filename output file
+    */
+    void Write(std::string filename);
+
+};
+
+#endif //  FitTimer_H
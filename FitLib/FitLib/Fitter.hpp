@@ -5,6 +5,9 @@
 #include "Variables.hpp"
 #include "FitModel.hpp"
 #include "Log.hpp"
+#include "FitResultUtils.hpp"
+#include "FitTimer.hpp"
+#include "FitPipeline.hpp"
 
 #include "RooFitResult.h"
 
@@ -40,6 +43,35 @@ private:
     /** RooFitResult */
     RooFitResult* m_result;
 
+    /** Timing of the fit stages */
+    FitTimer m_timer;
+
+    /** Parameters before the first stage (values, errors and constant flags) */
+    std::unique_ptr<RooArgSet> m_initial_pars;
+
+    /** Default stages: initial fit, then a second fit if the checks fixed anything */
+    std::vector<FitPipeline::Stage> DefaultStages();
+
+    /**
+     * Run the checks of a stage and lock the parameters they fix
+     * @param stage stage that has just run
+     * @param pipeline fit pipeline
+    */
+    void RunChecks(const FitPipeline::Stage& stage, FitPipeline& pipeline);
+
+    /**
+     * Run the stages of a pipeline, with their checks
+     * @param pipeline fit pipeline
+     * @param pdf PDF to fit
+     * @param data data to fit
+     * @param label prefix of the stage names in the log and the timing
+     * @return fit result of the last stage
+    */
+    RooFitResult* RunStages(FitPipeline& pipeline, RooAbsPdf& pdf, RooAbsData& data, std::string label);
+
+    /** Directory and prename of the output files */
+    std::string OutputPrefix();
+
 public:
 
     /**
@@ -70,6 +102,15 @@ public:
     /* Write output to file */
     void SaveOutput();
 
+    /* Initialise the parameters, and the covariance of the first fit, from a previous fit */
+    void WarmStart(FitPipeline& pipeline);
+
+    /* Repeat the fit stages unbinned, from the starting values of the binned fit, and compare */
+    void CompareUnbinned();
+
+    /* Profile the component shapes and write the timing of the fit */
+    void WriteTiming(std::string filename);
+
 };
 
 #endif //  Fitter_H
@@ -0,0 +1,215 @@
+#ifndef FIXEDMATRIX_H
+#define FIXEDMATRIX_H
+
+#include "TMatrixD.h"
+#include "TVectorD.h"
+
+#include <cmath>
+#include <utility>
+
+/**
+ * Namespace containing small matrices and vectors whose sizes are known
+ * at compile time. The storage is on the stack and row-major, so the
+ * loops have constant trip counts over contiguous memory and vectorise.
+ * Used for the nprods x nprods unfolding and nbins x nbins migration maths,
+ * which run in toy loops where TMatrixD/TVectorD would allocate.
+*/
+namespace FixedMatrix {
+
+    /**
+     * Vector of N doubles
+    */
+    template <int N>
+    struct Vector {
+        static constexpr int size = N;
+        alignas(32) double data[N] = {};
+
+        double& operator()(int i){ return data[i]; }
+        double operator()(int i) const { return data[i]; }
+
+        Vector& operator+=(const Vector& other){
+            for (int i=0; i<N; i++) data[i] += other.data[i];
+            return *this;
+        }
+
+        /** Copy from a TVectorD of size N */
+        static Vector FromTVector(const TVectorD& v){
+            Vector out;
+            for (int i=0; i<N; i++) out.data[i] = v(i);
+            return out;
+        }
+
+        /** Copy to a TVectorD */
+        TVectorD ToTVector() const {
+            TVectorD out(N);
+            for (int i=0; i<N; i++) out(i) = data[i];
+            return out;
+        }
+    };
+
+    /**
+     * R x C matrix, row-major
+    */
+    template <int R, int C>
+    struct Matrix {
+        static constexpr int rows = R;
+        static constexpr int cols = C;
+        alignas(32) double data[R*C] = {};
+
+        double& operator()(int i, int j){ return data[i*C + j]; }
+        double operator()(int i, int j) const { return data[i*C + j]; }
+
+        /** Identity matrix */
+        static Matrix Identity(){
+            static_assert(R == C, "Identity of a non-square matrix");
+            Matrix out;
+            for (int i=0; i<R; i++) out(i, i) = 1;
+            return out;
+        }
+
+        /** Transpose */
+        Matrix<C, R> Transpose() const {
+            Matrix<C, R> out;
+            for (int i=0; i<R; i++){
+                for (int j=0; j<C; j++) out(j, i) = (*this)(i, j);
+            }
+            return out;
+        }
+
+        /** Copy from an R x C TMatrixD */
+        static Matrix FromTMatrix(const TMatrixD& m){
+            Matrix out;
+            for (int i=0; i<R; i++){
+                for (int j=0; j<C; j++) out(i, j) = m(i, j);
+            }
+            return out;
+        }
+
+        /** Copy to a TMatrixD */
+        TMatrixD ToTMatrix() const {
+            TMatrixD out(R, C);
+            for (int i=0; i<R; i++){
+                for (int j=0; j<C; j++) out(i, j) = (*this)(i, j);
+            }
+            return out;
+        }
+    };
+
+    /** Matrix times vector */
+    template <int R, int C>
+    inline Vector<R> operator*(const Matrix<R, C>& m, const Vector<C>& v){
+        Vector<R> out;
+        for (int i=0; i<R; i++){
+            const double* row = &m.data[i*C];
+            double sum = 0;
+            for (int j=0; j<C; j++) sum += row[j] * v.data[j];
+            out.data[i] = sum;
+        }
+        return out;
+    }
+
+    /** Matrix times matrix, in i-k-j order so the inner loop runs over contiguous rows */
+    template <int R, int K, int C>
+    inline Matrix<R, C> operator*(const Matrix<R, K>& a, const Matrix<K, C>& b){
+        Matrix<R, C> out;
+        for (int i=0; i<R; i++){
+            double* out_row = &out.data[i*C];
+            for (int k=0; k<K; k++){
+                double a_ik = a.data[i*K + k];
+                const double* b_row = &b.data[k*C];
+                for (int j=0; j<C; j++) out_row[j] += a_ik * b_row[j];
+            }
+        }
+        return out;
+    }
+
+    /**
+     * LU decomposition with partial pivoting of an N x N matrix.
+     * Decomposed once, then solves without inverting.
+    */
+    template <int N>
+    class LU {
+
+    private:
+        /** L (below the diagonal, unit diagonal) and U (on and above) */
+        Matrix<N, N> m_lu;
+
+        /** Row permutation */
+        int m_perm[N];
+
+        /** Was a zero pivot found */
+        bool m_singular = true;
+
+    public:
+        LU(){ for (int i=0; i<N; i++) m_perm[i] = i; }
+
+        /**
+         * Decompose a matrix
+         * @param a matrix to decompose
+        */
+        explicit LU(const Matrix<N, N>& a){
+            m_lu = a;
+            m_singular = false;
+            for (int i=0; i<N; i++) m_perm[i] = i;
+            for (int k=0; k<N; k++){
+
+                // Pivot on the largest element of the column
+                int pivot = k;
+                for (int i=k+1; i<N; i++){
+                    if (std::abs(m_lu(i, k)) > std::abs(m_lu(pivot, k))) pivot = i;
+                }
+                if (m_lu(pivot, k) == 0){
+                    m_singular = true;
+                    continue;
+                }
+                if (pivot != k){
+                    for (int j=0; j<N; j++) std::swap(m_lu(k, j), m_lu(pivot, j));
+                    std::swap(m_perm[k], m_perm[pivot]);
+                }
+
+                // Eliminate below the pivot
+                for (int i=k+1; i<N; i++){
+                    double f = m_lu(i, k) / m_lu(k, k);
+                    m_lu(i, k) = f;
+                    for (int j=k+1; j<N; j++) m_lu(i, j) -= f * m_lu(k, j);
+                }
+            }
+        }
+
+        /** Is the matrix singular */
+        bool Singular() const { return m_singular; }
+
+        /**
+         * Solve A x = b
+         * @param b right-hand side
+        */
+        Vector<N> Solve(const Vector<N>& b) const {
+            Vector<N> x;
+            for (int i=0; i<N; i++){
+                double sum = b.data[m_perm[i]];
+                for (int j=0; j<i; j++) sum -= m_lu(i, j) * x.data[j];
+                x.data[i] = sum;
+            }
+            for (int i=N-1; i>=0; i--){
+                double sum = x.data[i];
+                for (int j=i+1; j<N; j++) sum -= m_lu(i, j) * x.data[j];
+                x.data[i] = sum / m_lu(i, i);
+            }
+            return x;
+        }
+
+        Matrix<N, N> Inverse() const {
+            Matrix<N, N> out;
+            for (int j=0; j<N; j++){
+                Vector<N> e;
+                e.data[j] = 1;
+                Vector<N> column = Solve(e);
+                for (int i=0; i<N; i++) out(i, j) = column.data[i];
+            }
+            return out;
+        }
+    };
+
+}
+
+#endif //  FixedMatrix_H
@@ -0,0 +1,130 @@
+#ifndef MCMATRICES_H
+#define MCMATRICES_H
+
+#include "Variables.hpp"
+#include "EfficiencyUtils.hpp"
+
+#include "RooDataSet.h"
+#include "TMatrixD.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Namespace containing the derivation of the efficiency matrices
+ * directly from the signal MC, in place of the precomputed files.
+*/
+namespace MCMatrices {
+
+    /**
+     * Index of a flavour-corrected DP bin in Definitions::DP_BINS,
+     * with the same convention as Selection::BinCut
+     * @param bin DP bin of the candidate
+     * @param kaon_charge charge of the kaon of the KPi tag
+     * @return index, -1 if the bin is outside the DP bins
+    */
+    inline int BinIndex(int bin, double kaon_charge){
+        if (kaon_charge > 0) bin = -bin;
+        if (bin == 0 || abs(bin) > EfficiencyUtils::nbins/2) return -1;
+        return (bin < 0) ? bin + EfficiencyUtils::nbins/2 : bin + EfficiencyUtils::nbins/2 - 1;
+    }
+
+    /**
+     * Sums of weights and squared weights of the MC candidates, [reco bin][true bin]
+    */
+    struct MigrationCounts {
+        double sumw[EfficiencyUtils::nbins][EfficiencyUtils::nbins] = {};
+        double sumw2[EfficiencyUtils::nbins][EfficiencyUtils::nbins] = {};
+        MigrationCounts& operator+=(const MigrationCounts& other);
+    };
+
+    /**
+     * Matrix with the statistical uncertainty of each element
+    */
+    struct MatrixWithErrors {
+        TMatrixD matrix;
+        TMatrixD errors;
+    };
+
+    /**
+     * Count the MC candidates in each pair of reconstructed and true DP bins.
+     * The dataset is read once, then the candidates are counted in chunks
+     * shared between threads, each filling its own counts.
+     * @param mc signal MC with the DP bin, true DP bin and kaon charge
+     * @param vars Variables class
+     * @param nthreads number of threads
+    */
+    MigrationCounts CountMigration(RooDataSet& mc, Variables* vars, int nthreads = 1);
+
+    /**
+     * Migration matrix, M[reco][true], each true bin normalised to the
+     * candidates reconstructed in the DP bins. The errors are binomial,
+     * using the squared weights for weighted MC.
+     * @param counts counts of the MC candidates
+    */
+    MatrixWithErrors MigrationMatrix(const MigrationCounts& counts);
+
+    /**
+     * Write the migration matrix as the migMatrix histogram read by
+     * EfficiencyUtils::ReadMigrationFile, with the errors as bin errors
+     * @param filename output ROOT file
+     * @param migration migration matrix
+    */
+    void WriteMigrationMatrix(std::string filename, const MatrixWithErrors& migration);
+
+    /** Tags with unfolding matrices */
+    const std::vector<std::string> TAGS = {"KK", "PiPi", "KSPi0", "PiPiPi0", "KPi", "KSPiPi"};
+
+    /**
+     * True production mechanism of a signal MC candidate from its truth flags,
+     * as an index of Definitions::PRODS. The D* -> D gamma decays flip the C
+     * parity of the D pair, so D*D* with one photon is even and with two is odd.
+    */
+    inline int TrueProd(bool dst_to_gamma, bool dst_to_piz, bool dstdst_to_gamma_gamma, bool dstdst_to_piz_gamma, bool dstdst_to_piz_piz){
+        if (dst_to_gamma) return 1;
+        if (dst_to_piz) return 2;
+        if (dstdst_to_piz_gamma) return 3;
+        if (dstdst_to_gamma_gamma || dstdst_to_piz_piz) return 4;
+        return 0;
+    }
+
+    /**
+     * Signal MC candidates of each true production mechanism, and of those
+     * the candidates passing the tag and production cuts, [selected][true]
+    */
+    struct UnfoldingCounts {
+        double selected[EfficiencyUtils::nprods][EfficiencyUtils::nprods] = {};
+        double total[EfficiencyUtils::nprods] = {};
+        UnfoldingCounts& operator+=(const UnfoldingCounts& other);
+    };
+
+    /**
+     * Count the candidates of the truth tree of a tag, in one pass over the
+     * signal MC shared between threads that each read their own chain.
+     * Fills the counts of the tag and, for KSPiPi, of each |bin| of the DP.
+     * @param files signal MC ROOT files
+     * @param tag name of the tag
+     * @param nthreads number of threads
+     * @return counts keyed by the name of the unfolding matrix file
+    */
+    std::map<std::string, UnfoldingCounts> CountUnfolding(const std::vector<std::string>& files, std::string tag, int nthreads = 1);
+
+    /**
+     * Unfolding matrix, U[selected][true], the fraction of the candidates of
+     * each true production mechanism passing each selection, with binomial errors
+     * @param counts counts of the MC candidates
+    */
+    MatrixWithErrors UnfoldingMatrix(const UnfoldingCounts& counts);
+
+    /**
+     * Write an unfolding matrix in the percentage text format read by
+     * EfficiencyUtils::ReadUnfoldingFile
+     * @param filename output text file
+     * @param unfolding unfolding matrix
+    */
+    void WriteUnfoldingMatrix(std::string filename, const TMatrixD& unfolding);
+
+}
+
+#endif //  MCMatrices_H
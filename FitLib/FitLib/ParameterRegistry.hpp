@@ -0,0 +1,93 @@
+#ifndef PARAMETERREGISTRY_H
+#define PARAMETERREGISTRY_H
+
+#include "RooRealVar.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Registry of the fit parameters, filled when the model is built.
+ * Each parameter is tagged with a role, the category and component that
+ * own it, and whether it is a background slope. The fitters query it by
+ * role or component instead of matching parameter names.
+*/
+class ParameterRegistry {
+
+public:
+    /**
+     * Role of a parameter
+     * Yield: component yield
+     * Shape: shape parameter of one category
+     * Shared: shape parameter shared between categories
+     * Physics: parameters of interest (rCosDelta, rSinDelta, Ntot, n_signal)
+     * Nuisance: other parameters (floating Yi, external constants)
+    */
+    enum Role { Yield, Shape, Shared, Physics, Nuisance, NRoles };
+
+    /**
+     * Details of a registered parameter
+    */
+    struct Entry {
+        RooRealVar* var;
+        Role role;
+        std::string category;
+        std::string component;
+        bool slope;
+    };
+
+    /**
+     * Register a parameter; parameters that are already registered are ignored
+     * @param var parameter
+     * @param role role of the parameter
+     * @param category category that owns it ("" if not binned)
+     * @param component component that owns it
+     * @param slope is it a background slope
+    */
+    void Register(RooRealVar* var, Role role, std::string category = "", std::string component = "", bool slope = false);
+
+    /** Registry entry of a parameter, null if it isn't registered */
+    const Entry* Find(const RooAbsArg* var) const;
+
+    /** Parameters with a role */
+    const std::vector<RooRealVar*>& Get(Role role) const { return m_by_role[role]; }
+
+    /**
+     * Parameters owned by one component of a category
+     * @param category category label ("" if not binned)
+     * @param component name of the component
+    */
+    const std::vector<RooRealVar*>& Get(std::string category, std::string component) const;
+
+    /** Background slopes */
+    const std::vector<RooRealVar*>& Slopes() const { return m_slopes; }
+
+    /**
+     * Fix or float all of the parameters with a role
+     * @param role role of the parameters
+     * @param constant fix (true) or float (false)
+    */
+    void SetConstant(Role role, bool constant);
+
+    /**
+     * Role from its name (yield, shape, shared, physics, nuisance), NRoles if unknown
+     * @param name name of the role
+    */
+    static Role RoleFromString(std::string name);
+
+private:
+    /** Entries, in the order of registration */
+    std::vector<Entry> m_entries;
+
+    /** Index of the entry of each parameter */
+    std::unordered_map<const RooAbsArg*, std::size_t> m_index;
+
+    /** Parameters by role, by category/component and slopes */
+    std::vector<RooRealVar*> m_by_role[NRoles];
+    std::unordered_map<std::string, std::vector<RooRealVar*>> m_by_component;
+    std::vector<RooRealVar*> m_slopes;
+
+};
+
+#endif //  ParameterRegistry_H
@@ -0,0 +1,17 @@
+#ifndef PLOTSTYLE_H
+#define PLOTSTYLE_H
+
+/**
+ * Namespace containing the LHCb plot style, compiled from style.C
+*/
+namespace PlotStyle {
+
+    /**
+     * Make the LHCb style the current style, building it the first time
+     * it is called in the process
+    */
+    void Apply();
+
+}
+
+#endif //  PlotStyle_H
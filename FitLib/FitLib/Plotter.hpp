@@ -6,12 +6,19 @@
 #include "Data.hpp"
 #include "FitModel.hpp"
 #include "Log.hpp"
+#include "PlotStyle.hpp"
+#include "ProjectionGrid.hpp"
 
 #include "RooPlot.h"
+#include "RooCurve.h"
 #include "TAxis.h"
 #include "TLegend.h"
 #include "TROOT.h"
 
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 class Plotter {
@@ -35,6 +42,18 @@ private:
     /** Logging class */
     Log m_log;
 
+    /**
+     * Projected curves, computed once per observable, category, binning and
+     * set of components, then shared by the filled, unfilled, log and pull plots
+    */
+    std::map<std::string, std::unique_ptr<RooCurve>> m_curves;
+
+    /** Grids of the model with grid_projections, per category and number of bins */
+    std::map<std::pair<std::string, int>, std::unique_ptr<ProjectionGrid>> m_grids;
+
+    /** Data of each category */
+    std::map<std::string, std::unique_ptr<RooDataSet>> m_category_data;
+
     /** Plotting colours */
     std::vector<Color_t> m_colours = {kAzure-3, kTeal-7, kOrange+7, kMagenta-6, kYellow-6, kPink-8, kAzure+9, kSpring+4, kGray};
     std::map<TString, Color_t> m_component_colours =  { {"signal", kAzure+5},
@@ -73,20 +92,79 @@ public:
         m_fm = fm;
         m_debug = debug;
         m_log = Log("Plotter");
-        gROOT->ProcessLine(".x /home/mackay/DoubleTagFits/style.C");
+        PlotStyle::Apply();
     }
 
     // void ScatterPlot(TString output, bool toy = false, TString ylabel = "");
 
+    /**
+     * Data of a category, reduced once
+     * @param cat_name name of the category ("" for all of the data)
+    */
+    RooDataSet* CategoryData(std::string cat_name);
+
+    /** Are the projections summed on a grid */
+    bool UseGrid(){
+        static const Settings::Key key = Settings::Intern("grid_projections");
+        return m_settings.getB(key);
+    }
+
+    /**
+     * Grid of the model, filled once
+     * @param cat_name name of the category
+     * @param nbins number of bins of the data along each observable
+    */
+    ProjectionGrid* Grid(std::string cat_name, int nbins);
+
+    /**
+     * Projection of the PDF, or of the sum of some of its components, from the cache.
+     * Sums of several components are built from the single-component curves.
+     * @param var observable
+     * @param nbins number of bins of the data normalising the projection
+     * @param cat_name name of the category
+     * @param components names of the components (empty for the full PDF)
+    */
+    const RooCurve* GetCurve(RooRealVar* var, int nbins, std::string cat_name, std::vector<std::string> components = {});
+
+    /**
+     * Add a copy of a cached curve to a frame
+     * @param frame frame to draw on
+     * @param curve cached curve
+     * @param name name of the curve, for the legend and the pulls
+     * @param colour line (and fill) colour
+     * @param style line style
+     * @param width line width
+     * @param filled fill the curve
+    */
+    void AddCurve(RooPlot* frame, const RooCurve* curve, TString name, Color_t colour, Style_t style, Width_t width, bool filled = false);
+
     /** Plot a D decay projection */
     void PlotProjection(RooPlot* frame, bool filled, int nbins, std::string cat_name = "");
 
+    /**
+     * Plot the 2D residual and pull maps, from the grid of the model
+     * @param cat_name name of the category
+    */
+    void PlotResiduals(std::string cat_name = "");
+
     /** Plot the pulls */
     RooPlot* PlotPulls(RooPlot* f, RooRealVar* var);
 
     /** Make a filled composite plot */
     void Plot(bool log, bool filled, bool pulls, std::string cat_name = "");
 
+    /**
+     * Plot the fit of each category, filled and unfilled. With plot_workers
+     * set, the categories are shared between forked worker processes, each
+     * with its own plotter, as RooFit projections aren't thread safe.
+     * @param settings Fit config
+     * @param vars Variable class
+     * @param dt Data class
+     * @param category_models fit model of each category
+     * @param debug boolean
+    */
+    static void PlotCategories(Settings settings, Variables* vars, Data* dt, std::map<std::string, FitModel*> category_models, bool debug = false);
+
     /** Mass scatter plot */
     void ScatterPlot(RooDataSet d, bool toy);
 
@@ -109,7 +187,8 @@ public:
 
     /** Get the legend label */
     TString GetPlotLabel(TString component){
-        TString tag = m_settings.getT("tag");
+        static const Settings::Key key_tag = Settings::Intern("tag");
+        TString tag = m_settings.getT(key_tag);
         std::map<TString, TString> latex_component_names = {
             {"signal", "K#pi vs. " + m_particle_labels[tag]},
             {"kpi_vs_comb", "K#pi vs. Comb."},
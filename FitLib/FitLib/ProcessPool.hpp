@@ -0,0 +1,85 @@
+#ifndef PROCESSPOOL_H
+#define PROCESSPOOL_H
+
+#include <functional>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * Namespace containing functions to run tasks in forked worker processes.
+ * RooFit objects are not thread safe, so work that minimises or generates
+ * from the model runs in copies of the process that share the loaded data
+ * and the built model copy-on-write.
+*/
+namespace ProcessPool {
+
+    /**
+     * Run each task in its own child process and collect the values it returns
+     * @param ntasks number of tasks
+     * @param nworkers maximum number of child processes running at once
+     * @param task function run in the child, called with the task index
+     * @return values returned by each task (empty if the child failed)
+    */
+    std::vector<std::vector<double>> Map(int ntasks, int nworkers, std::function<std::vector<double>(int)> task);
+
+    /**
+     * Persistent child processes, forked once, that each answer a stream of
+     * requests. Requests and replies are vectors of values sent over pipes.
+    */
+    class Workers {
+
+    public:
+        /**
+         * Constructor function, forks the workers
+         * @param nworkers number of child processes
+         * @param serve function run in the child for each request
+        */
+        Workers(int nworkers, std::function<std::vector<double>(const std::vector<double>&)> serve);
+
+        /** Deconstructor function, closes the requests and collects the workers */
+        ~Workers();
+
+        /** Number of workers */
+        int Size() const { return m_workers.size(); }
+
+        /** Is this the process that forked the workers */
+        bool Owner() const;
+
+        /**
+         * Send a request to a worker
+         * @param w worker
+         * @param request values of the request
+        */
+        void Send(int w, const std::vector<double>& request);
+
+        /**
+         * Wait for the reply of a worker to its last request
+         * @param w worker
+        */
+        std::vector<double> Receive(int w);
+
+        /**
+         * Wait for the first reply of any worker with a request in progress
+         * @param reply values of the reply
+         * @return worker that replied
+        */
+        int ReceiveAny(std::vector<double>& reply);
+
+    private:
+        /** Running worker and the pipes to and from it */
+        struct Worker {
+            pid_t pid;
+            int request_fd;
+            int reply_fd;
+            bool busy;
+        };
+        std::vector<Worker> m_workers;
+
+        /** Process that forked the workers */
+        pid_t m_owner;
+
+    };
+
+}
+
+#endif //  ProcessPool_H
@@ -0,0 +1,72 @@
+#ifndef PROFILESCANNER_H
+#define PROFILESCANNER_H
+
+#include "Settings.hpp"
+#include "Variables.hpp"
+#include "Data.hpp"
+#include "Log.hpp"
+
+#include "RooAbsPdf.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Class to scan the profile likelihood on a 2D grid of two parameters,
+ * by default (rCosDelta, rSinDelta). The model and data are built once;
+ * the grid rows are split between worker processes and each worker walks
+ * its rows in a serpentine path, starting every point from its finished
+ * neighbour. The scan profiles the parameters floating in the current
+ * state of the PDF, so after BinnedFitter::RunFit only the yields float.
+*/
+class ProfileScanner {
+
+private:
+    /** Fit configuration class */
+    Settings m_settings;
+
+    /** Variables class */
+    Variables* m_vars;
+
+    /** PDF to scan */
+    RooAbsPdf* m_pdf;
+
+    /** Data class */
+    Data* m_dt;
+
+    /** Debug flag */
+    bool m_debug;
+
+    /** Logging class */
+    Log m_log;
+
+    /**
+     * Read the grid of one axis from the settings
+     * @param axis x or y
+     * @param var scanned parameter
+    */
+    std::vector<double> GetGrid(std::string axis, RooRealVar* var);
+
+public:
+    /**
+    Constructor function, sets all of the private member objects
+    * @param settings fit config
+    * @param vars Class storing all of the variables
+    * @param pdf PDF at its global minimum
+    * @param dt Class containing the datasets
+    */
+    ProfileScanner(Settings settings, Variables* vars, RooAbsPdf* pdf, Data* dt, bool debug = false){
+        m_settings = settings;
+        m_vars = vars;
+        m_pdf = pdf;
+        m_dt = dt;
+        m_debug = debug;
+        m_log = Log("ProfileScanner");
+    }
+
+    /** Run the scan and write the grid to file */
+    void Run();
+
+};
+
+#endif //  ProfileScanner_H
@@ -0,0 +1,97 @@
+#ifndef PROJECTIONGRID_H
+#define PROJECTIONGRID_H
+
+#include "FitModel.hpp"
+#include "Log.hpp"
+
+#include "RooCurve.h"
+#include "RooDataSet.h"
+#include "RooRealVar.h"
+#include "TH2D.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Components of a fit model evaluated once on a shared (m_kpi, m_tag) grid.
+ * The grid has oversample x oversample cells per bin of the plotted data.
+ * Each component is evaluated at the cell centres, in one batch over a
+ * dataset of the centres, scaled to its yield, and
+ * the 1D projections of any sum of components are sums over the grid in
+ * place of a numerical integral per curve point. The same grid gives the
+ * expected events in each 2D bin, for residual and pull maps.
+*/
+class ProjectionGrid {
+
+public:
+    /**
+     * Constructor function
+     * @param x first observable (m_kpi)
+     * @param y second observable (m_tag)
+     * @param nbins number of bins of the data along each observable
+     * @param oversample number of grid cells per bin along each observable
+    */
+    ProjectionGrid(RooRealVar* x, RooRealVar* y, int nbins, int oversample = 4);
+
+    /**
+     * Evaluate the components of a fit model on the grid
+     * @param fm fit model
+     * @param nworkers number of forked worker processes sharing the rows of the grid
+    */
+    void Fill(FitModel* fm, int nworkers = 1);
+
+    /**
+     * Projection of a sum of components, in events per bin of the data, at the cell centres
+     * @param var observable to project on, m_kpi or m_tag by name
+     * @param components names of the components (empty for all of them)
+    */
+    std::vector<double> Projection(RooRealVar* var, std::vector<std::string> components = {}) const;
+
+    /**
+     * Projection of a sum of components as a curve
+     * @param var observable to project on
+     * @param name name of the curve
+     * @param components names of the components (empty for all of them)
+    */
+    std::unique_ptr<RooCurve> Curve(RooRealVar* var, std::string name, std::vector<std::string> components = {}) const;
+
+    /** 2D maps of the data compared to the model */
+    struct Maps {
+        std::unique_ptr<TH2D> residuals;
+        std::unique_ptr<TH2D> pulls;
+    };
+
+    /**
+     * Residual (data - model) and pull ((data - model) / sqrt(model)) maps in the bins of the data
+     * @param data dataset of the category
+     * @param prename prefix of the histogram names
+    */
+    Maps ResidualMaps(RooDataSet& data, std::string prename = "") const;
+
+private:
+    /** Observables */
+    RooRealVar* m_x;
+    RooRealVar* m_y;
+
+    /** Bins of the data and grid cells along each observable */
+    int m_nbins;
+    int m_oversample;
+    int m_n;
+
+    /** Events in each cell of the grid (x-major), per component */
+    std::map<std::string, std::vector<double>> m_values;
+
+    /** Sum of the cells of some components */
+    std::vector<double> Sum(const std::vector<std::string>& components) const;
+
+    /** Centre of a cell along an observable */
+    double Centre(RooRealVar* var, int i) const { return var->getMin() + (i + 0.5) * (var->getMax() - var->getMin()) / m_n; }
+
+    /** Logging class */
+    Log m_log;
+
+};
+
+#endif //  ProjectionGrid_H
@@ -1,21 +1,57 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "TString.h"
 #include "Log.hpp"
 
 /**
  * Class to reading the fit configuration from a text file
- * The text file contains a list of keys and values 
+ * The text file contains a list of keys and values
  * which are read into a dictionary.
+ *
+ * The values are parsed once, when they are read, into an immutable snapshot
+ * indexed by interned keys and shared by every copy of the class. A copy
+ * costs two reference counts; update_value writes to a small overlay of the
+ * copy (copied on write, sorted by key), so per-category overrides such as
+ * prename and bin_number leave the shared snapshot untouched. Keys read in
+ * hot paths are interned once by the caller (static const Settings::Key).
 */
 class Settings {
 
   public:
+    /** Interned key, the same for the same name for the whole process */
+    using Key = int;
+
+    /**
+     * Intern a key
+     * @param name name of the key
+    */
+    static Key Intern(const std::string& name);
+
+    /**
+     * Value of a setting, parsed once
+    */
+    struct Value {
+        std::string str;
+        bool is_number = false;
+        double d = 0;
+        bool is_int = false;
+        int i = 0;
+        bool b = false;
+
+        /** Parse a value, ignoring the surrounding spaces */
+        Value(std::string value);
+    };
+
     /** Empty constructor function */
     Settings(){}
 
@@ -25,70 +61,73 @@ class Settings {
     /** Empty deconstructor function */
     ~Settings(){};
 
-    /** Read the config into a dictionary {key, value} */
-    void read(){
-        m_log.info(("Reading settings file from " + m_filename).c_str());
-        std::ifstream infile; infile.open(m_filename);
-        std::string line;
-        while (std::getline(infile, line)){
-            line = line.substr(0, line.find("*")); // ignore comments in the config file
-            if (line[0] == '*') continue;
-            std::string delimiter = " ";
-            std::string var = line.substr(0, line.find(delimiter)); 
-            std::string val = line.substr(line.find(delimiter) + 1, line.size());
-            m_var_map.insert({var, val});
-        }
-        infile.close();
-        return;
-    }
+    /** Read the config into a new snapshot, keeping the settings already set */
+    void read();
 
     /** Update the value of a setting */
-    void update_value(std::string key, std::string value){
-        m_var_map[key] = value;
-        return;
-    }
+    void update_value(std::string key, std::string value);
 
     /** Check if a key exists in the dictionary */
-    bool key_exists(std::string key){
-        bool found = false;
-        if (m_var_map.count(key) > 0){ found = true; }
-        return found;
-    }
+    bool key_exists(std::string key) const { return Find(Lookup(key)) != nullptr; }
+    bool key_exists(Key key) const { return Find(key) != nullptr; }
 
     /** Read a boolean from the settings */
-    bool getB(std::string key){
-        bool val = false;
-        if ( !key_exists(key) ){ m_log.warning( ("Can't read key: " + key + "\nReturning false").c_str() ); }
-        else{
-            if (m_var_map[key] == "true"){ val = true; }
-        }
-        return val;
+    bool getB(std::string key) const {
+        const Value* v = Find(Lookup(key));
+        if (!v){ Log("Settings").warning( ("Can't read key: " + key + "\nReturning false").c_str() ); }
+        return v && v->b;
     }
+    bool getB(Key key) const { const Value* v = Find(key); return v && v->b; }
 
     /** Read a string from the settings */
-    std::string get(std::string key){ return m_var_map[key]; }
+    std::string get(std::string key) const { return get(Lookup(key)); }
+    std::string get(Key key) const { const Value* v = Find(key); return v ? v->str : ""; }
 
     /** Read a TString from the settings */
-    TString getT(std::string key){ return m_var_map[key].c_str(); }
+    TString getT(std::string key) const { return get(key).c_str(); }
+    TString getT(Key key) const { return get(key).c_str(); }
 
     /** Read a double from the settings */
-    double getD(std::string key){ return std::stod(m_var_map[key]); }
+    double getD(std::string key) const { return getD(Lookup(key)); }
+    double getD(Key key) const { const Value* v = Find(key); return (v && v->is_number) ? v->d : std::stod(v ? v->str : ""); }
 
     /** Read an integer from the settings */
-    double getI(std::string key){ return std::stoi(m_var_map[key]); }
+    int getI(std::string key) const { return getI(Lookup(key)); }
+    int getI(Key key) const { const Value* v = Find(key); return (v && v->is_int) ? v->i : std::stoi(v ? v->str : ""); }
 
     /** Return the dictionary */
-    std::map<std::string, std::string> get_map(){ return m_var_map; }
+    std::map<std::string, std::string> get_map() const;
 
     /** Get the name of the settings file */
-    std::string getFilename(){ return m_filename; }
+    std::string getFilename() const { return m_filename; }
 
   private:
+    /** Values of a snapshot, indexed by key (null if not set) */
+    using Snapshot = std::vector<std::shared_ptr<const Value>>;
+
+    /** Values set on top of the snapshot, sorted by key */
+    using Overlay = std::vector<std::pair<Key, std::shared_ptr<const Value>>>;
+
+    /** Interned key of a name, -1 if the name was never set */
+    static Key Lookup(const std::string& name);
+
+    /** Value of a key, the overlay first, null if not set */
+    const Value* Find(Key key) const {
+        if (key < 0) return nullptr;
+        if (m_overlay){
+            auto it = std::lower_bound(m_overlay->begin(), m_overlay->end(), key, [](const std::pair<Key, std::shared_ptr<const Value>>& entry, Key k){ return entry.first < k; });
+            if (it != m_overlay->end() && it->first == key) return it->second.get();
+        }
+        if (m_snapshot && key < (Key) m_snapshot->size()) return (*m_snapshot)[key].get();
+        return nullptr;
+    }
+
     /** Name of the settings file */
     std::string m_filename;
 
-    /** Dictionary */
-    std::map<std::string, std::string> m_var_map;
+    /** Shared snapshot and overlay */
+    std::shared_ptr<const Snapshot> m_snapshot;
+    std::shared_ptr<const Overlay> m_overlay;
 
     /** Logging class */
     Log m_log;
@@ -0,0 +1,90 @@
+#ifndef SIMULTANEOUSNLL_H
+#define SIMULTANEOUSNLL_H
+
+#include "ProcessPool.hpp"
+
+#include "RooAbsReal.h"
+#include "RooAbsData.h"
+#include "RooListProxy.h"
+#include "RooRealVar.h"
+#include "RooSimultaneous.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Negative log-likelihood of a RooSimultaneous evaluated category by category.
+ * RooFit evaluation is not thread safe, so the categories are shared between
+ * persistent forked workers, each with its own copy of the model and its own
+ * constant-term optimisation. Each call queues the categories longest first
+ * (from the evaluation times of the previous call) and hands the next one to
+ * whichever worker replies first. The partial sums are added in a fixed
+ * category order so the result does not depend on the scheduling.
+*/
+class SimultaneousNLL : public RooAbsReal {
+
+public:
+    /**
+     * Constructor function, creates one extended NLL per category
+     * @param name name of the NLL
+     * @param pdf simultaneous PDF
+     * @param data combined dataset with the category index
+     * @param cat_name name of the index category
+     * @param labels category labels
+     * @param nworkers number of worker processes (1 to evaluate serially)
+    */
+    SimultaneousNLL(const char* name, RooSimultaneous& pdf, RooAbsData& data, std::string cat_name, std::vector<std::string> labels, int nworkers);
+
+    /** Copy constructor, shares the category NLLs */
+    SimultaneousNLL(const SimultaneousNLL& other, const char* name = 0);
+
+    TObject* clone(const char* newname) const override { return new SimultaneousNLL(*this, newname); }
+
+    /** Errors from a change of 0.5 in the NLL */
+    double defaultErrorLevel() const override { return 0.5; }
+
+    /** Category labels, in the order of the partial sums */
+    const std::vector<std::string>& Labels() const { return m_labels; }
+
+    /** NLL of each category from the last evaluation */
+    const std::vector<double>& PartialSums() const { return *m_partial; }
+
+    /** Evaluation time of each category (seconds) from the last evaluation */
+    const std::vector<double>& Costs() const { return *m_costs; }
+
+    /** Total evaluation time of each category (seconds) over all evaluations */
+    const std::vector<double>& TotalCosts() const { return *m_total_costs; }
+
+    /** Number of evaluations */
+    long NumEvaluations() const { return *m_nevals; }
+
+protected:
+    double evaluate() const override;
+
+private:
+    /** Category NLLs as servers, so parameter changes propagate */
+    RooListProxy m_nlls;
+
+    /** Owned per-category datasets and NLLs */
+    std::shared_ptr<std::vector<std::unique_ptr<RooAbsData>>> m_data;
+    std::shared_ptr<std::vector<std::unique_ptr<RooAbsReal>>> m_owned_nlls;
+
+    /** Category labels */
+    std::vector<std::string> m_labels;
+
+    /** Parameters of the category NLLs, whose values are sent to the workers */
+    std::vector<RooRealVar*> m_params;
+
+    /** Worker processes (null for serial evaluation) */
+    std::shared_ptr<ProcessPool::Workers> m_workers;
+
+    /** Results and timing of the last evaluation */
+    std::shared_ptr<std::vector<double>> m_partial;
+    std::shared_ptr<std::vector<double>> m_costs;
+    std::shared_ptr<std::vector<double>> m_total_costs;
+    std::shared_ptr<long> m_nevals;
+
+};
+
+#endif //  SimultaneousNLL_H
@@ -0,0 +1,91 @@
+#ifndef SYSTEMATICSRUNNER_H
+#define SYSTEMATICSRUNNER_H
+
+#include "Settings.hpp"
+#include "Variables.hpp"
+#include "Data.hpp"
+#include "Log.hpp"
+
+#include "RooAbsPdf.h"
+#include "RooRealVar.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Class to run systematic variations of the constants of the fit without
+ * rebuilding the data or the model. Each variation sets some constant
+ * RooRealVars (e.g. xD, yD, c3, s-3, K5 or the unfolding matrix elements),
+ * refits starting from the nominal minimum and records the shifts of the
+ * floating parameters. Variations are shared between worker processes.
+ *
+ * The variations file has one change per line, grouped by name:
+ *   name parameter value
+ *   name unfolding systematic_file_ender
+*/
+class SystematicsRunner {
+
+private:
+    /** Fit configuration class */
+    Settings m_settings;
+
+    /** Variables class */
+    Variables* m_vars;
+
+    /** PDF at its nominal minimum */
+    RooAbsPdf* m_pdf;
+
+    /** Data class */
+    Data* m_dt;
+
+    /** Debug flag */
+    bool m_debug;
+
+    /** Logging class */
+    Log m_log;
+
+    /**
+     * One variation: the constants to change and their new values
+    */
+    struct Variation {
+        std::string name;
+        std::vector<std::pair<RooRealVar*, double>> changes;
+    };
+
+    /**
+     * Read the variations file
+     * @param pars parameters of the PDF
+    */
+    std::vector<Variation> ReadVariations(const RooArgSet& pars);
+
+    /**
+     * Add the unfolding matrix elements of a systematic file ender to a variation
+     * @param variation variation to add to
+     * @param ender systematic_file_ender of the alternative matrices
+    */
+    void AddUnfolding(Variation& variation, std::string ender);
+
+public:
+    /**
+    Constructor function, sets all of the private member objects
+    * @param settings fit config
+    * @param vars Class storing all of the variables
+    * @param pdf PDF at its nominal minimum
+    * @param dt Class containing the datasets
+    */
+    SystematicsRunner(Settings settings, Variables* vars, RooAbsPdf* pdf, Data* dt, bool debug = false){
+        m_settings = settings;
+        m_vars = vars;
+        m_pdf = pdf;
+        m_dt = dt;
+        m_debug = debug;
+        m_log = Log("SystematicsRunner");
+    }
+
+    /** Run the variations and write the shifts to file */
+    void Run();
+
+};
+
+#endif //  SystematicsRunner_H
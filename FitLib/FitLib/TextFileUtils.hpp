@@ -6,6 +6,8 @@
 #include <iostream>
 #include <fstream>
 
+#include "Settings.hpp"
+
 /**
  * Namespace containing utility functions to read/write to text files
 */
@@ -17,6 +19,18 @@ namespace TextFileUtils {
     */
     std::vector<std::string> ReadList(std::string filename);
 
+    /**
+     * Split a comma-separated list of settings into its entries, without whitespace
+     * @param value list to split
+    */
+    std::vector<std::string> SplitList(std::string value);
+
+    /**
+     * Prefix of the output files: outdir (default output/<tag>/<prod>) and prename
+     * @param settings fit config
+    */
+    std::string OutputPrefix(Settings settings);
+
 }
 
 #endif //  TextFileUtils_H
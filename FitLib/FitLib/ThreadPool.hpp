@@ -0,0 +1,75 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Persistent pool of worker threads with one task queue per worker.
+ * Each batch of tasks is distributed over the queues using cost estimates
+ * (longest first, to the least loaded queue) and idle workers steal from
+ * the back of the other queues.
+*/
+class ThreadPool {
+
+public:
+    /**
+     * Constructor function, starts the workers
+     * @param nthreads number of worker threads
+    */
+    ThreadPool(int nthreads);
+
+    /** Deconstructor function, stops and joins the workers */
+    ~ThreadPool();
+
+    /**
+     * Run a batch of tasks and wait for all of them to finish
+     * @param tasks functions to run
+     * @param costs estimated cost of each task (empty for equal costs)
+    */
+    void Run(const std::vector<std::function<void()>>& tasks, const std::vector<double>& costs = {});
+
+    /** Number of worker threads */
+    int Size() const { return m_workers.size(); }
+
+private:
+    /** Task queue owned by a single worker */
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    /** Main loop of each worker */
+    void WorkerLoop(int id);
+
+    /** Take a task from the worker's own queue, or steal one */
+    bool PopTask(int id, int& task);
+
+    /** Worker threads and their queues */
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+
+    /** Current batch of tasks */
+    const std::vector<std::function<void()>>* m_tasks = nullptr;
+
+    /** Synchronisation between the caller and the workers */
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    unsigned long m_generation = 0;
+    int m_remaining = 0;
+    int m_active = 0;
+    bool m_stop = false;
+
+    /** First exception thrown by a task in the current batch */
+    std::exception_ptr m_error;
+
+};
+
+#endif //  ThreadPool_H
@@ -0,0 +1,57 @@
+#ifndef TOYSTUDY_H
+#define TOYSTUDY_H
+
+#include "Settings.hpp"
+#include "Log.hpp"
+
+#include "RooAbsPdf.h"
+#include "RooArgSet.h"
+
+#include <string>
+
+/**
+ * Class to generate and fit pseudo-experiments from a built model.
+ * The toys are shared between worker processes; toy i always uses the
+ * seed toy_seed + i, so the results do not depend on the number of workers.
+ * Before each toy the parameters are reset to the generation values.
+*/
+class ToyStudy {
+
+private:
+    /** Fit configuration class */
+    Settings m_settings;
+
+    /** PDF to generate from and fit */
+    RooAbsPdf* m_pdf;
+
+    /** Observables to generate (including the index category of a simultaneous PDF) */
+    RooArgSet m_observables;
+
+    /** Debug flag */
+    bool m_debug;
+
+    /** Logging class */
+    Log m_log;
+
+public:
+    /**
+    Constructor function, sets all of the private member objects
+    * @param settings fit config
+    * @param pdf PDF, with the parameters at their generation values
+    * @param observables observables to generate
+    * @param debug boolean
+    */
+    ToyStudy(Settings settings, RooAbsPdf* pdf, RooArgSet observables, bool debug = false){
+        m_settings = settings;
+        m_pdf = pdf;
+        m_observables.add(observables);
+        m_debug = debug;
+        m_log = Log("ToyStudy");
+    }
+
+    /** Generate and fit the toys and write the pulls to file */
+    void Run();
+
+};
+
+#endif //  ToyStudy_H
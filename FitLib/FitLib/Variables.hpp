@@ -4,6 +4,7 @@
 #include "Settings.hpp"
 #include "Definitions.hpp"
 #include "Inputs.hpp"
+#include "ParameterRegistry.hpp"
 
 #include "RooRealVar.h"
 #include "RooArgList.h"
@@ -11,6 +12,7 @@
 #include "RooCategory.h"
 
 #include "TString.h"
+#include "TMatrixD.h"
 
 class Variables {
 
@@ -130,11 +132,22 @@ public:
     std::map<std::string, std::map<int, RooFormulaVar*>> Ni;
     std::map<std::string, std::map<int, RooAbsArg*>> Yi;
 
+    /**
+     * Elements of the migration matrix and of the unfolding matrix in each DP bin
+    */
+    std::vector<std::vector<RooRealVar*>> migration_matrix;
+    std::map<int, std::vector<std::vector<RooRealVar*>>> unfolding_matrices;
+
     /**
      * C-values per production mechanism
     */
     std::map<std::string, RooRealVar*> C_vars;
 
+    /**
+     * Roles of the fit parameters
+    */
+    ParameterRegistry registry;
+
     /**
     * Empty constructor function
     */
@@ -240,6 +253,10 @@ public:
 
             Ki_vars[bin] = new RooRealVar(("K" + std::to_string(bin)).c_str(), "", Inputs::Ki[bin]);
             Ki_vars[bin]->setConstant(true);
+
+            registry.Register(ci_vars[bin], ParameterRegistry::Nuisance);
+            registry.Register(si_vars[bin], ParameterRegistry::Nuisance);
+            registry.Register(Ki_vars[bin], ParameterRegistry::Nuisance);
         }
 
         // Fixed constants
@@ -249,6 +266,8 @@ public:
         yD = new RooRealVar("yD", "", Inputs::YMIX);
         if (s.key_exists("alt_ymix_val")) yD->setVal(s.getD("alt_ymix_val"));
         yD->setConstant(true);
+        registry.Register(xD, ParameterRegistry::Nuisance);
+        registry.Register(yD, ParameterRegistry::Nuisance);
 
         // KSpipi observables
         m_prename = (s.key_exists("prename")) ? s.getT("prename") : "";
@@ -261,6 +280,9 @@ public:
         integrated_N["DST0D0_pi"] = new RooRealVar("Ntot_DST0D0_pi", "", 8492, 5e3, 75e3);
         integrated_N["DST0DST0_even"] = new RooRealVar("Ntot_DST0DST0_even", "", 9317, 5e3, 75e3);
         integrated_N["DST0DST0_odd"] = new RooRealVar("Ntot_DST0DST0_odd", "", 11505, 7e3, 85e3);
+        registry.Register(rCosDelta, ParameterRegistry::Physics);
+        registry.Register(rSinDelta, ParameterRegistry::Physics);
+        for (auto N: integrated_N) registry.Register(N.second, ParameterRegistry::Physics);
 
         // C-values
         C_vars["D0D0"] = new RooRealVar("C_D0D0", "", -1);
@@ -296,6 +318,25 @@ public:
     /** Initialise floating yield in each category */
     void InitialiseNi();
 
+    /**
+     * Replace the values of the migration matrix elements
+     * @param migration migration matrix, [reco bin][true bin]
+    */
+    void SetMigrationMatrix(const TMatrixD& migration);
+
+    /**
+     * Replace the values of the unfolding matrix elements of a DP region
+     * @param bin |bin| of the DP region
+     * @param unfolding unfolding matrix
+    */
+    void SetUnfoldingMatrix(int bin, const TMatrixD& unfolding);
+
+    /** Strategy of the Yi: default, float or float_by_C */
+    std::string YiStrategy(){
+        if (m_settings.key_exists("Yi_strategy")) return m_settings.get("Yi_strategy");
+        return "default";
+    }
+
     /** Initalise the Yi */
     void InitialiseYi(){
         if (m_settings.get("Yi_strategy") == "float") FloatingYi();
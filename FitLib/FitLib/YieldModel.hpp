@@ -0,0 +1,88 @@
+#ifndef YIELDMODEL_H
+#define YIELDMODEL_H
+
+#include "Variables.hpp"
+#include "EfficiencyUtils.hpp"
+#include "Log.hpp"
+
+#include "RooArgList.h"
+
+#include <vector>
+
+/**
+ * Closed-form evaluation of the KSPiPi signal yields Ni[prod][bin] and of
+ * their Jacobian with respect to rCosDelta, rSinDelta and the integrated
+ * yields Ntot. It mirrors the RooFormulaVar graph of Variables with the
+ * default Yi strategy: DefaultYi -> TotalNi -> migration -> unfolding.
+ * The constants of the graph (Ki, ci, si, mixing, matrices) are read by Update().
+*/
+class YieldModel {
+
+private:
+    /** Variables class */
+    Variables* m_vars;
+
+    /** Logging class */
+    Log m_log;
+
+    /** Parameters: rCosDelta, rSinDelta, then Ntot in the order of Definitions::PRODS */
+    RooArgList m_pars;
+
+    /** Constants of the yield graph */
+    static const int nbins = EfficiencyUtils::nbins;
+    static const int nprods = EfficiencyUtils::nprods;
+    double m_K[nbins], m_Kbar[nbins], m_c[nbins], m_s[nbins];
+    double m_xD, m_yD, m_C[2];
+    EfficiencyUtils::BinMatrix m_migration;
+    EfficiencyUtils::ProdMatrix m_unfolding[nbins];
+    int m_prod_C[nprods];
+
+    /** Yields [prod][bin] and Jacobian [prod][bin][parameter] of the last evaluation */
+    std::vector<double> m_yields;
+    std::vector<double> m_jacobian;
+
+public:
+    /**
+    Constructor function, reads the constants of the yield graph
+    * @param vars Class storing all of the variables
+    */
+    YieldModel(Variables* vars);
+
+    /** Read the constants of the yield graph from the variables */
+    void Update();
+
+    /**
+     * Evaluate the yields and the Jacobian
+     * @param x parameter values, in the order of Parameters()
+    */
+    void Evaluate(const double* x);
+
+    /** Evaluate the yields and the Jacobian at the current parameter values */
+    void Evaluate();
+
+    /** Parameters of the yield graph */
+    const RooArgList& Parameters() const { return m_pars; }
+
+    /** Number of parameters */
+    int NumParameters() const { return m_pars.getSize(); }
+
+    /**
+     * Yield of the last evaluation
+     * @param prod index of the production mechanism in Definitions::PRODS
+     * @param bin index of the DP bin in Definitions::DP_BINS
+    */
+    double Yield(int prod, int bin) const { return m_yields[prod*nbins + bin]; }
+
+    /**
+     * Gradient of a yield with respect to the parameters
+     * @param prod index of the production mechanism in Definitions::PRODS
+     * @param bin index of the DP bin in Definitions::DP_BINS
+    */
+    const double* Gradient(int prod, int bin) const { return &m_jacobian[(prod*nbins + bin)*NumParameters()]; }
+
+    /** Largest relative difference between the closed-form yields and the RooFit yields */
+    double Validate();
+
+};
+
+#endif //  YieldModel_H
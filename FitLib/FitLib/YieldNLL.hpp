@@ -0,0 +1,109 @@
+#ifndef YIELDNLL_H
+#define YIELDNLL_H
+
+#include "Variables.hpp"
+#include "BinnedFitModel.hpp"
+#include "YieldModel.hpp"
+#include "Log.hpp"
+
+#include "Math/IFunction.h"
+#include "RooAbsData.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Extended NLL of the simultaneous KSPiPi fit once all of the shape
+ * parameters are fixed, as a function of the parameters of the YieldModel.
+ * The normalised component densities of every event are evaluated once, so
+ * the NLL and its analytic gradient only depend on the yields:
+ * NLL = sum_cat [ sum_j n_j - sum_events w log(sum_j n_j f_j) ],
+ * which is RooFit's extended NLL up to a constant.
+ * Yields of other components are either constant or proportional to the
+ * signal yield of the category (e.g. a fixed rate).
+ * The densities are stored in one contiguous matrix, so the event loops
+ * are plain multiply-adds and dot products that the compiler can vectorise.
+*/
+class YieldNLL : public ROOT::Math::IMultiGradFunction {
+
+private:
+    /**
+     * Yield structure of one category and the position of its events
+     * in the density matrix
+    */
+    struct Category {
+        std::string label;
+        int prod;
+        int bin;
+        unsigned int ncomp;
+        unsigned int nevents;
+        std::size_t density_offset;
+        std::size_t event_offset;
+        std::vector<double> constant;
+        std::vector<double> rate;
+    };
+
+    /** Closed-form yields */
+    YieldModel* m_yields;
+
+    /** Categories */
+    std::vector<Category> m_categories;
+
+    /** Normalised component densities, contiguous in events: [category][component][event] */
+    std::vector<double> m_densities;
+
+    /** Event weights: [category][event] */
+    std::vector<double> m_weights;
+
+    /** Per-event work space */
+    mutable std::vector<double> m_work;
+
+    /** Reason the NLL can't be used, empty if valid */
+    std::string m_invalid;
+
+    /** Logging class */
+    Log m_log;
+
+    /** Call counters */
+    mutable long m_nevals = 0;
+    mutable long m_ngrads = 0;
+
+    /** Gradient at the last point, reused by DoDerivative */
+    mutable std::vector<double> m_last_x;
+    mutable std::vector<double> m_last_grad;
+
+    /** NLL and gradient (if grad is not null) */
+    double Compute(const double* x, double* grad) const;
+
+    double DoEval(const double* x) const override;
+    double DoDerivative(const double* x, unsigned int icoord) const override;
+
+public:
+    /**
+    Constructor function, caches the component densities of each event
+    * @param fm binned fit model with fixed shapes
+    * @param vars Class storing all of the variables
+    * @param data unbinned combined dataset
+    * @param yields closed-form yields
+    * @param debug boolean
+    */
+    YieldNLL(BinnedFitModel* fm, Variables* vars, RooAbsData& data, YieldModel* yields, bool debug = false);
+
+    /** Can the NLL be used for the current configuration */
+    bool Valid() const { return m_invalid.empty(); }
+
+    /** Reason the NLL can't be used */
+    std::string Reason() const { return m_invalid; }
+
+    unsigned int NDim() const override { return m_yields->NumParameters(); }
+    ROOT::Math::IMultiGenFunction* Clone() const override { return new YieldNLL(*this); }
+    void Gradient(const double* x, double* grad) const override;
+    void FdF(const double* x, double& f, double* df) const override;
+
+    /** Number of NLL and gradient evaluations */
+    long NumEvaluations() const { return m_nevals; }
+    long NumGradients() const { return m_ngrads; }
+
+};
+
+#endif //  YieldNLL_H
@@ -1,59 +1,335 @@
 #include "BinnedFitter.hpp"
 
+#include "ProcessPool.hpp"
+#include "TextFileUtils.hpp"
+
+#include "Math/Factory.h"
+
+namespace {
+
+    /** Settings read by the fit and each of its stages, interned once */
+    const Settings::Key key_warm_start_file = Settings::Intern("warm_start_file");
+    const Settings::Key key_resume_from_stage = Settings::Intern("resume_from_stage");
+    const Settings::Key key_binned_fit_compare = Settings::Intern("binned_fit_compare");
+    const Settings::Key key_analytic_gradient = Settings::Intern("analytic_gradient");
+    const Settings::Key key_fast_yield_fit = Settings::Intern("fast_yield_fit");
+    const Settings::Key key_parallel_minos = Settings::Intern("parallel_minos");
+    const Settings::Key key_nll_workers = Settings::Intern("nll_workers");
+    const Settings::Key key_fit_timing = Settings::Intern("fit_timing");
+
+}
+
 void BinnedFitter::RunFit(){
 
-    // Initial fit
-    if (m_debug) m_log.info("Running the first fit ...");
-    auto r = m_fm->pdf->fitTo(*m_dt->data, RooFit::Save(1), RooFit::Extended(1), RooFit::NumCPU(6));
-    r->Print("v");
+    // Stages from the settings
+    FitPipeline pipeline(m_settings, m_vars, DefaultStages(), m_debug);
+    auto stages = pipeline.Stages();
 
-    // Second fit
-    RooFitResult* second_r;
-    if (CheckYields() | CheckBkgSlopes()){
-        if (m_debug) m_log.info("Running the second fit ...");
-        second_r = m_fm->pdf->fitTo(*m_dt->data, RooFit::Save(1), RooFit::Extended(1), RooFit::NumCPU(6));
-        second_r->Print("v");
+    // Start from a previous fit
+    if (m_settings.key_exists(key_warm_start_file)) WarmStart(pipeline);
+    std::unique_ptr<RooArgSet> pdf_pars(m_fm->pdf->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag)));
+    m_initial_pars.reset((RooArgSet*) pdf_pars->snapshot());
+    m_result = nullptr;
+
+    // Stage to resume from: restore the state after the previous stage and rerun its checks
+    int first = 0;
+    if (m_settings.key_exists(key_resume_from_stage)){
+        std::string resume = m_settings.get(key_resume_from_stage);
+        first = pipeline.Find(resume);
+        if (first < 0){
+            m_log.warning(("Unknown stage " + resume + ", running all of the fit stages").c_str());
+            first = 0;
+        }
+    }
+    if (first > 0){
+        pipeline.Prepare(stages[first - 1]);
+        m_result = LoadCheckpoint(stages[first - 1].name);
+        pipeline.Finish();
+        RunChecks(stages[first - 1], pipeline);
     }
-    else second_r = r;
 
-    // MINOS fit
-    if (m_debug) m_log.info("Running the MINOS fit ...");
-    FixAllPars();
-    m_result = m_fm->pdf->fitTo(*m_dt->data, RooFit::Save(1), RooFit::Extended(1), RooFit::Minos(m_vars->minos_vars));
-    m_result->Print("v");
+    // Fit stages
+    for (unsigned int i=first; i<stages.size(); i++){
+        if (pipeline.Skip(stages[i])){
+            if (m_debug) m_log.info("Skipping the " + stages[i].name + " fit");
+            if (m_result) SaveCheckpoint(stages[i].name, m_result);
+            continue;
+        }
+        if (m_debug) m_log.info("Running the " + stages[i].name + " fit ...");
+        pipeline.Prepare(stages[i]);
+        long nll_evals = 0;
+        m_timer.Start(stages[i].name, 0);
+        m_result = Minimise(pipeline, stages[i], nll_evals);
+        m_timer.Stop(m_result, nll_evals);
+        m_result->Print("v");
+        pipeline.Finish();
+        SaveCheckpoint(stages[i].name, m_result);
+        RunChecks(stages[i], pipeline);
+    }
+    if (!m_result){
+        m_log.error("No fit stage was run");
+        exit(1);
+    }
 
+    // Bias of the binned fit
+    if (m_dt->FitData() != m_dt->data.get() && m_settings.getB(key_binned_fit_compare)) CompareUnbinned();
 
     m_log.success("Fit complete!");
     return;
 }
 
 
-bool BinnedFitter::CheckYields(){    
+std::string BinnedFitter::OutputPrefix(){
+    return TextFileUtils::OutputPrefix(m_settings);
+}
+
+
+void BinnedFitter::SaveCheckpoint(std::string stage, RooFitResult* r){
+    std::string filename = OutputPrefix() + "checkpoint_" + stage + ".root";
+    if (m_debug) m_log.info("Saving checkpoint to " + filename);
+    std::unique_ptr<RooArgSet> pdf_pars(m_fm->pdf->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag)));
+    FitResultUtils::WriteCheckpoint(r, *pdf_pars, filename);
+    return;
+}
+
+
+RooFitResult* BinnedFitter::LoadCheckpoint(std::string stage){
+    std::string filename = OutputPrefix() + "checkpoint_" + stage + ".root";
+    m_log.info("Resuming from checkpoint " + filename);
+    std::unique_ptr<RooArgSet> pdf_pars(m_fm->pdf->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag)));
+    RooFitResult* r = FitResultUtils::ReadCheckpoint(*pdf_pars, filename);
+    if (!r){
+        m_log.error("Could not read checkpoint " + filename);
+        exit(1);
+    }
+    return r;
+}
+
+
+RooFitResult* BinnedFitter::Minimise(FitPipeline& pipeline, const FitPipeline::Stage& stage, long& nll_evals){
+
+    // Yield-only fit on the cached NLL and its analytic gradient when the shapes are fixed
+    bool analytic = m_settings.getB(key_analytic_gradient);
+    bool fast = m_settings.getB(key_fast_yield_fit);
+    if (pipeline.FixedShape(stage) && (analytic || fast)){
+        RooFitResult* r = FastYieldFit(stage);
+        if (r) return r;
+    }
+    bool parallel_minos = stage.minos && m_settings.key_exists(key_parallel_minos);
+
+    // Default: RooFit's own NLL
+    RooFitResult* r;
+    if (!m_settings.key_exists(key_nll_workers)) r = pipeline.Fit(*m_fm->FitPdf(), *m_dt->FitData(), stage, !parallel_minos, nll_evals);
+
+    // Category NLLs evaluated in worker processes
+    else{
+        if (!m_nll){
+            std::vector<std::string> labels;
+            for (auto category: m_fm->category_models) labels.push_back(category.first);
+            if (m_debug) m_log.info(("Evaluating the NLL in " + m_settings.get(key_nll_workers) + " worker processes").c_str());
+            m_nll = std::make_unique<SimultaneousNLL>("sim_nll", *m_fm->FitPdf(), *m_dt->FitData(), m_vars->cats->GetName(), labels, m_settings.getI(key_nll_workers));
+        }
+        r = pipeline.Minimise(*m_nll, stage, !parallel_minos, nll_evals);
+    }
+
+    // MINOS for each parameter in its own process
+    if (parallel_minos){
+        m_result = r;
+        RunParallelMinos();
+    }
+    return r;
+}
+
+
+std::vector<FitPipeline::Stage> BinnedFitter::DefaultStages(){
+    FitPipeline::Stage initial;
+    initial.name = "initial";
+    initial.ncpu = 6;
+    initial.checks = {"yields", "slopes"};
+    FitPipeline::Stage second;
+    second.name = "second";
+    second.ncpu = 6;
+    second.skip_if = "unchanged";
+    FitPipeline::Stage minos;
+    minos.name = "minos";
+    minos.floating = {ParameterRegistry::Physics};
+    minos.minos = true;
+    return {initial, second, minos};
+}
+
+
+void BinnedFitter::RunChecks(const FitPipeline::Stage& stage, FitPipeline& pipeline){
+    for (auto check: stage.checks){
+        if (check == "yields") CheckYields();
+        else if (check == "slopes") CheckBkgSlopes();
+    }
+    pipeline.Update();
+    return;
+}
+
+
+std::unique_ptr<ROOT::Math::Minimizer> BinnedFitter::YieldMinimizer(YieldNLL& nll, YieldModel& yields){
+    std::unique_ptr<ROOT::Math::Minimizer> minimizer(ROOT::Math::Factory::CreateMinimizer("Minuit2", "Migrad"));
+    minimizer->SetFunction(nll);
+    minimizer->SetErrorDef(0.5);
+    minimizer->SetStrategy(1);
+    minimizer->SetPrintLevel(m_debug ? 1 : 0);
+    const RooArgList& pars = yields.Parameters();
+    for (int k=0; k<pars.getSize(); k++){
+        RooRealVar* p = (RooRealVar*) pars.at(k);
+        double step = (p->getError() > 0) ? p->getError() : 0.01 * (p->getMax() - p->getMin());
+        if (p->isConstant()) minimizer->SetFixedVariable(k, p->GetName(), p->getVal());
+        else minimizer->SetLimitedVariable(k, p->GetName(), p->getVal(), step, p->getMin(), p->getMax());
+    }
+    return minimizer;
+}
+
+
+RooFitResult* BinnedFitter::FastYieldFit(const FitPipeline::Stage& stage){
+
+    // NLL of the yields with the shapes fixed
+    YieldModel yields(m_vars);
+    YieldNLL nll(m_fm, m_vars, *m_dt->FitData(), &yields, m_debug);
+    if (!nll.Valid()){
+        m_log.warning("Can't use the yield NLL, running the RooFit stage: " + nll.Reason());
+        return nullptr;
+    }
+    if (m_debug) m_log.info("Running MIGRAD, HESSE and MINOS on the cached yield NLL with its analytic gradient");
+    const RooArgList& pars = yields.Parameters();
+    std::vector<int> floating;
+    RooArgList floating_pars;
+    for (int k=0; k<pars.getSize(); k++){
+        if (((RooRealVar*) pars.at(k))->isConstant()) continue;
+        floating.push_back(k);
+        floating_pars.add(*pars.at(k));
+    }
+    std::unique_ptr<RooArgList> init_pars((RooArgList*) floating_pars.snapshot());
+    std::vector<std::pair<std::string, int>> history;
+    m_timer.Start("fast_yield_fit", 0);
+
+    // MIGRAD, whose status is the fit status, then HESSE
+    auto minimizer = YieldMinimizer(nll, yields);
+    bool converged = minimizer->Minimize();
+    int status = minimizer->Status();
+    history.push_back({"MIGRAD", status});
+    if (!converged) m_log.warning(("Fast yield fit: MIGRAD status " + std::to_string(status)).c_str());
+    minimizer->Hesse();
+    history.push_back({"HESSE", minimizer->Status()});
+    for (int k: floating){
+        RooRealVar* p = (RooRealVar*) pars.at(k);
+        p->setVal(minimizer->X()[k]);
+        p->setError(minimizer->Errors()[k]);
+        p->removeAsymError();
+    }
+    TMatrixDSym covariance(floating.size());
+    for (unsigned int i=0; i<floating.size(); i++){
+        for (unsigned int j=0; j<floating.size(); j++) covariance(i, j) = minimizer->CovMatrix(floating[i], floating[j]);
+    }
+    double min_nll = minimizer->MinValue();
+    double edm = minimizer->Edm();
+    int cov_qual = minimizer->CovMatrixStatus();
+
+    // MINOS
+    for (int k: floating){
+        if (!stage.minos) break;
+        RooRealVar* p = (RooRealVar*) pars.at(k);
+        if (!m_vars->minos_vars.find(p->GetName())) continue;
+        double error_lo = 0, error_hi = 0;
+        bool ok = minimizer->GetMinosError(k, error_lo, error_hi);
+        history.push_back({"MINOS", ok ? 0 : minimizer->MinosStatus()});
+        if (ok) p->setAsymError(error_lo, error_hi);
+        else m_log.warning(TString("MINOS failed for ") + p->GetName());
+    }
+
+    // Fit result, as RooFit would save it
+    std::unique_ptr<RooArgSet> pdf_pars(m_fm->pdf->getParameters(*m_dt->data));
+    RooArgList const_pars;
+    for (auto arg: *pdf_pars){
+        RooRealVar* p = dynamic_cast<RooRealVar*>(arg);
+        if (p && p->isConstant()) const_pars.add(*p);
+    }
+    if (m_debug) m_log.debug(("Fast yield fit: " + std::to_string(nll.NumEvaluations()) + " NLL and " + std::to_string(nll.NumGradients()) + " gradient evaluations").c_str());
+    RooFitResult* result = FitResultUtils::MakeFitResult("fast_yield_fit", *init_pars, floating_pars, const_pars, min_nll, edm, status, cov_qual, covariance, history);
+    m_timer.Stop(result, nll.NumEvaluations());
+    return result;
+}
+
+
+void BinnedFitter::CompareUnbinned(){
+    m_log.info("Repeating the fit stages unbinned, from the same starting values, to compare with the binned fit");
+    std::unique_ptr<RooArgSet> pdf_pars(m_fm->pdf->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag)));
+    std::unique_ptr<RooArgSet> binned_pars((RooArgSet*) pdf_pars->snapshot());
+    FitResultUtils::RestoreParameters(*pdf_pars, *m_initial_pars);
+
+    // Same stages and checks as the binned fit, with RooFit's NLL on the unbinned data
+    FitPipeline pipeline(m_settings, m_vars, DefaultStages(), m_debug);
+    RooFitResult* r = nullptr;
+    for (auto stage: pipeline.Stages()){
+        if (pipeline.Skip(stage)) continue;
+        if (m_debug) m_log.info("Running the unbinned " + stage.name + " fit ...");
+        pipeline.Prepare(stage);
+        long nll_evals = 0;
+        m_timer.Start("unbinned_" + stage.name, 0);
+        delete r;
+        r = pipeline.Fit(*m_fm->pdf, *m_dt->data, stage, true, nll_evals);
+        m_timer.Stop(r, nll_evals);
+        pipeline.Finish();
+        RunChecks(stage, pipeline);
+    }
+    if (!r){
+        m_log.error("No unbinned fit stage was run");
+        exit(1);
+    }
+    std::unique_ptr<RooFitResult> unbinned(r);
+
+    std::string outfile_name = OutputPrefix() + "binned_comparison.txt";
+    m_log.info("Writing the comparison to " + outfile_name);
+    FitResultUtils::WriteComparison(m_result, unbinned.get(), m_dt->IntegrateBins(), outfile_name);
+
+    // Back to the binned result
+    FitResultUtils::RestoreParameters(*pdf_pars, *binned_pars);
+    return;
+}
+
+
+void BinnedFitter::WarmStart(FitPipeline& pipeline){
+    std::string filename = m_settings.get(key_warm_start_file);
+    m_log.info("Initialising the parameters from " + filename);
+    auto snapshot = FitResultUtils::ReadSnapshot(filename);
+    std::unique_ptr<RooArgSet> pdf_pars(m_fm->pdf->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag)));
+    int n_set = FitResultUtils::ApplySnapshot(*pdf_pars, snapshot);
+    if (m_debug) m_log.debug(("Set " + std::to_string(n_set) + "/" + std::to_string(snapshot.size()) + " parameters from the snapshot").c_str());
+
+    // Covariance for the first minimisation
+    std::vector<std::string> names;
+    TMatrixDSym covariance;
+    if (FitResultUtils::ReadCovariance(filename, names, covariance)) pipeline.SeedCovariance(names, covariance);
+    else if (m_debug) m_log.debug("No usable covariance matrix in " + filename + ", only the step sizes are set");
+    return;
+}
+
+
+bool BinnedFitter::CheckYields(){
     if (m_debug) m_log.info("Checking for zero yields");
     bool second_fit = false;
-    std::map<std::string, FitModel*> category_models;
     for (auto category: m_fm->category_models){
         for (auto c: category.second->components){
-            RooRealVar* yield = (RooRealVar*) c.second.yield;
+            RooRealVar* yield = dynamic_cast<RooRealVar*>(c.second.yield);
+            const ParameterRegistry::Entry* entry = m_vars->registry.Find(yield);
+            if (!entry || entry->role != ParameterRegistry::Yield || yield->isConstant()) continue;
             if (yield->getVal() < 1){
 
                 // Fix yield
-                TString yield_name = yield->GetName();
-                if (yield_name.Contains("dstpdm") | yield_name.Contains("dstpdstm")) continue;
                 m_log.warning("Setting " + c.first + " yield to zero");
                 second_fit = true;
                 yield->setVal(0);
                 yield->setConstant(true);
 
-                // Fix associated parameters
-                RooArgSet* component_pars = c.second.shape->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag));
-                TIterator* iter(component_pars->createIterator());
-                for (TObject *a = iter->Next(); a != 0; a = iter->Next()) {
-                    RooRealVar *p = (RooRealVar*) a;  
-                    TString par_name = p->GetName();
-                    if (par_name.Contains("smear") | par_name.Contains("shared")) continue;
-                    m_log.warning("Fixing " + par_name);
-                    p->setConstant(true);            
+                // Fix the shape parameters of the component in this category
+                for (auto p: m_vars->registry.Get(entry->category, entry->component)){
+                    if (m_vars->registry.Find(p)->role != ParameterRegistry::Shape) continue;
+                    m_log.warning(TString("Fixing ") + p->GetName());
+                    p->setConstant(true);
                 }
             }
         }
@@ -66,33 +342,43 @@ bool BinnedFitter::CheckYields(){
 bool BinnedFitter::CheckBkgSlopes(){
     if (m_debug) m_log.info("Checking if bkg slopes are at limits");
     bool second_fit = false;
-    RooArgSet* pdf_pars = m_fm->pdf->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag));
-    TIterator* iter(pdf_pars->createIterator());
-    for (TObject *a = iter->Next(); a != 0; a = iter->Next()) {
-        RooRealVar *p = (RooRealVar*) a;
-        TString name = p->GetName();
-        if (name.Contains("exponent")){
-            double maxRatio = p->getVal() / p->getMax() ;
-            double minRatio = p->getVal() / p->getMin() ;
-            if (maxRatio > 0.99 | minRatio > 0.99){
-                if (m_debug){ m_log.debug(name + " was found to be at the limit. Fixing it."); }
-                p->setConstant(true);
-                second_fit = true;
-            }
+    for (auto p: m_vars->registry.Slopes()){
+        if (p->isConstant()) continue;
+        double maxRatio = p->getVal() / p->getMax() ;
+        double minRatio = p->getVal() / p->getMin() ;
+        if (maxRatio > 0.99 | minRatio > 0.99){
+            if (m_debug){ m_log.debug(TString(p->GetName()) + " was found to be at the limit. Fixing it."); }
+            p->setConstant(true);
+            second_fit = true;
         }
     }
     return second_fit;
 }
 
 
-void BinnedFitter::FixAllPars(){
-    RooArgSet* pdf_pars = m_fm->pdf->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag));
-    TIterator* iter(pdf_pars->createIterator());
-    for (TObject *a = iter->Next(); a != 0; a = iter->Next()) {
-        RooRealVar *p = (RooRealVar*) a;
-        TString name = p->GetName();
-        if (name.Contains("n_signal") | name.Contains("Delta") | name.Contains("Ntot")) continue;
-        p->setConstant(true);
+void BinnedFitter::RunParallelMinos(){
+    int nvars = m_vars->minos_vars.getSize();
+    if (m_debug) m_log.info(("Running MINOS for " + std::to_string(nvars) + " parameters on " + m_settings.get(key_parallel_minos) + " processes").c_str());
+
+    // Each child starts from the shared minimum and profiles one parameter.
+    // Threads do not survive fork, so the children always use fitTo.
+    auto errors = ProcessPool::Map(nvars, m_settings.getI(key_parallel_minos), [&](int i){
+        RooRealVar* var = (RooRealVar*) m_vars->minos_vars.at(i);
+        std::unique_ptr<RooFitResult> r(m_fm->FitPdf()->fitTo(*m_dt->FitData(), RooFit::Save(1), RooFit::Extended(1), RooFit::Hesse(0), RooFit::Minos(RooArgSet(*var)), RooFit::PrintLevel(-1)));
+        return std::vector<double>{var->getErrorLo(), var->getErrorHi(), (double) r->status()};
+    });
+
+    // Merge the asymmetric errors into the fit result
+    for (int i=0; i<nvars; i++){
+        RooRealVar* var = (RooRealVar*) m_vars->minos_vars.at(i);
+        if (errors[i].size() != 3){
+            m_log.warning(TString("MINOS failed for ") + var->GetName());
+            continue;
+        }
+        if (errors[i][2] != 0) m_log.warning(TString("MINOS status ") + std::to_string((int) errors[i][2]).c_str() + " for " + var->GetName());
+        var->setAsymError(errors[i][0], errors[i][1]);
+        RooRealVar* final_var = (RooRealVar*) m_result->floatParsFinal().find(var->GetName());
+        if (final_var) final_var->setAsymError(errors[i][0], errors[i][1]);
     }
     return;
 }
@@ -101,11 +387,7 @@ void BinnedFitter::FixAllPars(){
 void BinnedFitter::SaveOutput(){
 
     // Open the outfile
-    std::string prename = "";
-    std::string outdir = "output/" + m_settings.get("tag") + "/" + m_settings.get("prod");
-    if (m_settings.key_exists("prename")) prename = m_settings.get("prename");
-    if (m_settings.key_exists("outdir")) outdir = m_settings.get("outdir");
-    std::string outfile_name = outdir + "/" + prename + "fit_results.txt";
+    std::string outfile_name = OutputPrefix() + "fit_results.txt";
     m_log.info("Writing output to " + outfile_name);
     std::ofstream m_outfile;
     m_outfile.open(outfile_name);
@@ -141,5 +423,32 @@ void BinnedFitter::SaveOutput(){
 
     m_outfile.close();
 
+    // Binary snapshot for warm starts
+    FitResultUtils::WriteBinaryResults(m_result, outfile_name.substr(0, outfile_name.size() - 4) + ".root");
+
+    // Where the fit time went
+    if (m_settings.getB(key_fit_timing)) WriteTiming(OutputPrefix() + "fit_timing.txt");
+
+    // Migration matrix derived from the MC
+    if (m_dt->mc_migration) MCMatrices::WriteMigrationMatrix(OutputPrefix() + "mc_migration.root", *m_dt->mc_migration);
+
+    return;
+}
+
+
+void BinnedFitter::WriteTiming(std::string filename){
+
+    // NLL time of each category (multithreaded NLL only)
+    if (m_nll) m_timer.SetCategoryCosts(m_nll->Labels(), m_nll->TotalCosts(), m_nll->NumEvaluations());
+
+    // One pass of each component over the data of its category
+    for (auto category: m_fm->category_models){
+        std::string selection = std::string(m_vars->cats->GetName()) + "==" + m_vars->cats->GetName() + "::" + category.first;
+        std::unique_ptr<RooAbsData> cat_data(m_dt->FitData()->reduce(selection.c_str()));
+        std::map<std::string, RooAbsPdf*> shapes;
+        for (auto c: category.second->components) shapes[c.first] = c.second.shape;
+        m_timer.ProfileComponents(category.first, shapes, *cat_data);
+    }
+    m_timer.Write(filename);
     return;
 }
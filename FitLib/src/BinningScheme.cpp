@@ -0,0 +1,107 @@
+#include "BinningScheme.hpp"
+
+#include "TFile.h"
+
+#include <cmath>
+
+
+BinningScheme::GridAxis BinningScheme::MakeGridAxis(const TAxis* axis, int grid_size){
+    GridAxis grid;
+    grid.aligned = !axis->IsVariableBinSize();
+    grid.n = grid.aligned ? axis->GetNbins() : grid_size;
+    grid.min = axis->GetXmin();
+    grid.max = axis->GetXmax();
+    return grid;
+}
+
+
+int BinningScheme::CellBin(const GridAxis& grid, const TAxis* axis, int cell){
+    if (grid.aligned) return cell + 1;
+
+    // With a margin so rounding in the cell index can't cross a bin edge
+    const double margin = 1e-6;
+    double width = (grid.max - grid.min) / grid.n;
+    double low = grid.min + cell*width;
+    int bin = axis->FindFixBin(low + 0.5*width);
+    if (axis->FindFixBin(low - margin*width) != bin || axis->FindFixBin(low + (1 + margin)*width) != bin) return -1;
+    return bin;
+}
+
+
+BinningScheme::BinningScheme(std::string filename, std::string histname, int grid_size, bool signed_map){
+    m_log = Log("BinningScheme");
+    m_signed = signed_map;
+
+    // Read the bin map
+    TFile file(filename.c_str());
+    TH2* map = (TH2*) file.Get(histname.c_str());
+    if (!map){
+        m_log.error("No " + histname + " in " + filename);
+        return;
+    }
+    m_map.reset((TH2*) map->Clone());
+    m_map->SetDirectory(nullptr);
+    file.Close();
+
+    // Grid over the range of the map
+    const TAxis* xaxis = m_map->GetXaxis();
+    const TAxis* yaxis = m_map->GetYaxis();
+    m_x = MakeGridAxis(xaxis, grid_size);
+    m_y = MakeGridAxis(yaxis, grid_size);
+    m_grid.resize((std::size_t) m_x.n * m_y.n);
+    int nexact = 0;
+    for (int j=0; j<m_y.n; j++){
+        int ybin = CellBin(m_y, yaxis, j);
+        for (int i=0; i<m_x.n; i++){
+            int xbin = CellBin(m_x, xaxis, i);
+            int16_t& cell = m_grid[(std::size_t) j*m_x.n + i];
+            if (xbin < 0 || ybin < 0){
+                cell = exact;
+                nexact += 1;
+            }
+            else cell = std::lround(m_map->GetBinContent(xbin, ybin));
+        }
+    }
+    m_log.info(("Read " + histname + ", " + std::to_string(nexact) + "/" + std::to_string(m_grid.size()) + " grid cells use the exact lookup").c_str());
+}
+
+
+int BinningScheme::ExactBin(double mplus, double mminus) const {
+    return std::lround(m_map->GetBinContent(m_map->FindFixBin(mplus, mminus)));
+}
+
+
+int BinningScheme::Bin(double mplus, double mminus) const {
+    int i = m_x.Cell(mplus);
+    int j = m_y.Cell(mminus);
+    int bin = 0;
+    if (i >= 0 && j >= 0){
+        bin = m_grid[(std::size_t) j*m_x.n + i];
+        if (bin == exact) bin = ExactBin(mplus, mminus);
+    }
+    if (!m_signed && mminus <= mplus) bin = -bin;
+    return bin;
+}
+
+
+void BinningScheme::Bins(const double* mplus, const double* mminus, int* bins, std::size_t n) const {
+
+    // Grid lookups, branch-free so the loop vectorises, with the index
+    // arithmetic of GridAxis::Cell
+    const int16_t* grid = m_grid.data();
+    const double xrange = m_x.max - m_x.min, yrange = m_y.max - m_y.min;
+    for (std::size_t k=0; k<n; k++){
+        bool inside = (mplus[k] >= m_x.min) & (mplus[k] < m_x.max) & (mminus[k] >= m_y.min) & (mminus[k] < m_y.max);
+        double x = inside ? m_x.n * (mplus[k] - m_x.min) / xrange : 0;
+        double y = inside ? m_y.n * (mminus[k] - m_y.min) / yrange : 0;
+        std::size_t cell = (std::size_t) std::min(m_y.n - 1, (int) y) * m_x.n + std::min(m_x.n - 1, (int) x);
+        int bin = inside ? grid[cell] : 0;
+        bins[k] = (m_signed || mminus[k] > mplus[k]) ? bin : -bin;
+    }
+
+    // Cells crossed by a bin edge of the map
+    for (std::size_t k=0; k<n; k++){
+        if (std::abs(bins[k]) == -exact) bins[k] = Bin(mplus[k], mminus[k]);
+    }
+    return;
+}
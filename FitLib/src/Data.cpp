@@ -1,6 +1,8 @@
 #include "Data.hpp"
 #include "TextFileUtils.hpp"
 
+#include <cmath>
+
 std::unique_ptr<TChain> Data::LoadMCChain(TString sample, bool bkg_prod, bool bkg_decay){
 
     if (m_debug) m_log.info("Loading the " + sample + " into a TChain");
@@ -38,10 +40,12 @@ std::unique_ptr<RooDataSet> Data::LoadData(){
 
     // Apply selection criteria
     std::unique_ptr<TTree> data_cut;
+    TTree* selected = &data_chain;
     if (m_apply_cuts){
         TString full_cut = Selection::ProdCut(m_prod, m_tag); // Production mechanism
         if (Selection::TagCut(m_tag) != "") full_cut += " & " + Selection::TagCut(m_tag); // Tag
         data_cut.reset(data_chain.CopyTree(full_cut));
+        selected = data_cut.get();
         if (m_debug){
             m_log.debug("Applying cut to the data: " + full_cut);
             m_log.success( (std::to_string(data_cut->GetEntries()) + "/" + std::to_string(data_chain.GetEntries()) + " candidates passed the cut").c_str() );
@@ -49,11 +53,10 @@ std::unique_ptr<RooDataSet> Data::LoadData(){
     }
     else{
         if (m_debug) m_log.warning("No cuts applied to the data");
-        data_cut.reset(&data_chain);
     }
 
     // Load into a RooDataSet
-    std::unique_ptr<RooDataSet> ds = std::make_unique<RooDataSet>("data", "", m_vars->data_vars, RooFit::Import(*data_cut));
+    std::unique_ptr<RooDataSet> ds = std::make_unique<RooDataSet>("data", "", m_vars->data_vars, RooFit::Import(*selected));
     if (m_debug) ds->Print("v");
 
     return ds;
@@ -102,6 +105,57 @@ std::unique_ptr<RooDataSet> Data::LoadMCSample(TString sample, bool bkg_prod, bo
 }
 
 
+Data::Data(Settings settings, Variables* vars, Data* sample, bool debug){
+
+    m_settings = settings;
+    m_vars = vars;
+    m_apply_cuts = true;
+    m_debug = debug;
+    Initialise();
+
+    // Selection of this configuration
+    TString full_cut = Selection::ProdCut(m_prod, m_tag);
+    if (Selection::TagCut(m_tag) != "") full_cut += " & " + Selection::TagCut(m_tag);
+    if (m_debug) m_log.debug("Selecting from the shared sample: " + full_cut);
+
+    // Reduce the shared samples
+    data = std::unique_ptr<RooDataSet>(static_cast<RooDataSet*>(sample->data->reduce(full_cut)));
+    std::unique_ptr<RooDataSet> all_signal_mc(static_cast<RooDataSet*>(sample->signal_mc->reduce(full_cut)));
+    if (m_settings.getB("sample_signal_mc")){ signal_mc = DataUtils::RandomlySampleDataset(m_settings.getD("sampling_frac"), all_signal_mc); }
+    else{ signal_mc = std::move(all_signal_mc); }
+    bkg_mc = std::unique_ptr<RooDataSet>(static_cast<RooDataSet*>(sample->bkg_mc->reduce(full_cut)));
+    other_prod_mc = std::unique_ptr<RooDataSet>(static_cast<RooDataSet*>(sample->other_prod_mc->reduce(full_cut)));
+    TruthMatchComponents();
+
+}
+
+
+RooAbsData* Data::FitData(){
+    if (!(m_settings.key_exists("binned_fit") && m_settings.getB("binned_fit"))) return data.get();
+    if (!binned_data){
+        int nbins = 100;
+        if (m_settings.key_exists("binned_fit_nbins")) nbins = m_settings.getI("binned_fit_nbins");
+        RooArgSet observables(*m_vars->m_kpi, *m_vars->m_tag);
+        if (m_tag == "KSPiPi") observables.add(*m_vars->cats);
+        binned_data = DataUtils::BinDataset(*data, observables, nbins);
+        if (m_debug) m_log.debug(("Binned " + std::to_string(data->numEntries()) + " candidates into " + std::to_string(binned_data->numEntries()) + " bins").c_str());
+    }
+    return binned_data.get();
+}
+
+
+bool Data::IntegrateBins(){
+    if (FitData() == data.get()) return false;
+    return m_settings.key_exists("binned_fit_integrate") && m_settings.getB("binned_fit_integrate");
+}
+
+
+double Data::BinPrecision(){
+    if (m_settings.key_exists("binned_fit_precision")) return m_settings.getD("binned_fit_precision");
+    return 1e-3;
+}
+
+
 void Data::TruthMatchComponents(){
 
     // Read components
@@ -159,3 +213,61 @@ void Data::TruthMatchComponents(){
     }
     return;
 }
+
+
+void Data::UseMCMigration(const MCMatrices::MigrationCounts& counts){
+    mc_migration = std::make_unique<MCMatrices::MatrixWithErrors>(MCMatrices::MigrationMatrix(counts));
+    EfficiencyUtils::SetMigrationMatrix(mc_migration->matrix);
+    m_vars->SetMigrationMatrix(mc_migration->matrix);
+    if (m_debug) mc_migration->matrix.Print();
+    m_log.info("Using the migration matrix derived from the signal MC");
+    return;
+}
+
+
+void Data::UseMCUnfolding(){
+    auto counts = MCMatrices::CountUnfolding(SignalMCFiles(), m_tag.Data(), MCMatrixThreads());
+    for (auto& entry: counts){
+        mc_unfolding[entry.first] = MCMatrices::UnfoldingMatrix(entry.second);
+        const TMatrixD& unfolding = mc_unfolding[entry.first].matrix;
+        auto pos = entry.first.find("FTbin");
+        EfficiencyUtils::SetUnfoldingMatrix(EfficiencyUtils::UnfoldingFolder(m_settings, pos != std::string::npos), entry.first, unfolding);
+        if (pos != std::string::npos) m_vars->SetUnfoldingMatrix(std::stoi(entry.first.substr(pos + 5)), unfolding);
+        if (m_settings.key_exists("mc_unfolding_folder")) MCMatrices::WriteUnfoldingMatrix(m_settings.get("mc_unfolding_folder") + "/" + entry.first, unfolding);
+        if (m_debug) unfolding.Print();
+    }
+    m_log.info("Using the unfolding matrices derived from the signal MC");
+    return;
+}
+
+
+void Data::LoadBinningScheme(){
+    std::string hist = m_settings.key_exists("binning_scheme_hist") ? m_settings.get("binning_scheme_hist") : "dkpp_bin_h";
+    bool signed_map = !m_settings.key_exists("binning_scheme_signed") || m_settings.getB("binning_scheme_signed");
+    m_binning = std::make_unique<BinningScheme>(m_settings.get("binning_scheme"), hist, 1024, signed_map);
+    if (!m_binning->Valid()){
+        m_log.error("Can't read the binning scheme " + m_settings.get("binning_scheme"));
+        exit(1);
+    }
+    if (m_settings.key_exists("mc_migration") && m_settings.getB("mc_migration")) m_log.warning("The MC migration matrix uses the bins of the tuple, not the binning scheme");
+    return;
+}
+
+
+std::vector<int> Data::DalitzBins(RooDataSet& ds){
+    std::vector<double> kaon_charge = DataUtils::GetColumn(ds, m_vars->kaon_charge->GetName());
+    std::vector<int> bins(kaon_charge.size());
+    if (m_binning){
+        std::vector<double> mplus = DataUtils::GetColumn(ds, m_vars->m_ks_piplus->GetName());
+        std::vector<double> mminus = DataUtils::GetColumn(ds, m_vars->m_ks_piminus->GetName());
+        m_binning->Bins(mplus.data(), mminus.data(), bins.data(), bins.size());
+    }
+    else{
+        std::vector<double> tuple_bins = DataUtils::GetColumn(ds, m_vars->dalitz_bin->GetName());
+        for (unsigned int i=0; i<bins.size(); i++) bins[i] = std::lround(tuple_bins[i]);
+    }
+    for (unsigned int i=0; i<bins.size(); i++){
+        if (kaon_charge[i] > 0) bins[i] = -bins[i];
+    }
+    return bins;
+}
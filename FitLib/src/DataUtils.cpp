@@ -1,6 +1,12 @@
 
 #include "DataUtils.hpp"
 
+#include "Log.hpp"
+
+#include "RooBinSamplingPdf.h"
+#include "RooCustomizer.h"
+#include "RooRealVar.h"
+
 namespace DataUtils {
 
     std::unique_ptr<RooDataSet> RandomlySampleDataset(double sample_frac, std::unique_ptr<RooDataSet>& ds){
@@ -22,4 +28,66 @@ namespace DataUtils {
         return;
     }
 
+
+    std::unique_ptr<RooDataHist> BinDataset(RooDataSet& ds, RooArgSet observables, int nbins){
+        for (auto arg: observables){
+            RooRealVar* obs = dynamic_cast<RooRealVar*>(arg);
+            if (obs) obs->setBins(nbins, "binned_fit");
+        }
+        TString dsname = ds.GetName();
+        std::unique_ptr<RooDataHist> hist = std::make_unique<RooDataHist>(dsname + "_binned", "", observables, "binned_fit");
+        hist->add(ds);
+        return hist;
+    }
+
+
+
+    RooAbsPdf* IntegrateBins(RooAbsPdf& pdf, const std::vector<std::pair<RooAbsPdf*, RooRealVar*>>& shapes, double precision, std::string name){
+        RooCustomizer* customizer = new RooCustomizer(pdf, name.c_str());
+        for (auto shape: shapes){
+            RooRealVar* obs = shape.second;
+            if (!obs->hasBinning("binned_fit")){
+                Log("DataUtils").error(TString("No binned_fit binning for ") + obs->GetName() + ", bin the data first");
+                exit(1);
+            }
+            obs->setBinning(obs->getBinning("binned_fit"));
+            RooBinSamplingPdf* integrated = new RooBinSamplingPdf((std::string(shape.first->GetName()) + "_" + name).c_str(), "", *obs, *shape.first, precision);
+            customizer->replaceArg(*shape.first, *integrated);
+        }
+        return (RooAbsPdf*) customizer->build();
+    }
+
+
+    std::vector<double> GetColumn(RooDataSet& ds, TString name){
+        RooRealVar* var = (RooRealVar*) ds.get()->find(name);
+        if (!var){
+            Log("DataUtils").error("No " + name + " in " + ds.GetName());
+            exit(1);
+        }
+        std::vector<double> column(ds.numEntries());
+        for (int i=0; i<ds.numEntries(); i++){
+            ds.get(i);
+            column[i] = var->getVal();
+        }
+        return column;
+    }
+
+
+    std::map<int, RooDataSet*> PartitionDataset(RooDataSet& ds, const std::vector<int>& keys, const std::vector<int>& values){
+        TString dsname = ds.GetName();
+        std::map<int, RooDataSet*> parts;
+        for (int value: values){
+            TString name = dsname + "_" + std::to_string(value);
+            if (ds.isWeighted()) parts[value] = new RooDataSet(name, "", RooArgSet(*ds.get(), *ds.weightVar()), RooFit::WeightVar(*ds.weightVar()));
+            else parts[value] = new RooDataSet(name, "", *ds.get());
+        }
+        for (int i=0; i<ds.numEntries(); i++){
+            auto it = parts.find(keys[i]);
+            if (it == parts.end()) continue;
+            const RooArgSet* row = ds.get(i);
+            it->second->add(*row, ds.weight());
+        }
+        return parts;
+    }
+
 }
@@ -0,0 +1,162 @@
+#include "EfficiencyBundle.hpp"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const char magic[8] = {'D', 'T', 'F', 'E', 'F', 'F', 'B', '\0'};
+    const std::size_t header_size = 8 + 4 + 4 + 8;
+}
+
+
+EfficiencyBundle::EfficiencyBundle(std::string filename){
+    m_log = Log("EfficiencyBundle");
+
+    // Map the file
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0){
+        m_log.error("Can't open efficiency bundle " + filename);
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t) header_size){
+        m_size = info.st_size;
+        m_map = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m_map == MAP_FAILED) m_map = nullptr;
+    }
+    close(fd);
+    if (!m_map){
+        m_log.error("Can't map efficiency bundle " + filename);
+        return;
+    }
+    const char* base = (const char*) m_map;
+
+    // Header
+    uint32_t file_version, nmatrices;
+    uint64_t index_offset;
+    std::memcpy(&file_version, base + 8, 4);
+    std::memcpy(&nmatrices, base + 12, 4);
+    std::memcpy(&index_offset, base + 16, 8);
+    if (std::memcmp(base, magic, 8) != 0 || file_version != version){
+        m_log.error(("Efficiency bundle " + filename + " has the wrong format or version " + std::to_string(file_version)).c_str());
+        return;
+    }
+
+    // Index, checking every entry lies inside the mapping. The checks
+    // compare against the remaining sizes so corrupt values can't overflow.
+    if (index_offset > m_size){
+        m_log.error("Efficiency bundle " + filename + " is truncated");
+        return;
+    }
+    std::size_t pos = index_offset;
+    for (uint32_t i=0; i<nmatrices; i++){
+        if (m_size - pos < 20) break;
+        uint32_t rows, cols, name_length;
+        uint64_t offset;
+        std::memcpy(&rows, base + pos, 4);
+        std::memcpy(&cols, base + pos + 4, 4);
+        std::memcpy(&offset, base + pos + 8, 8);
+        std::memcpy(&name_length, base + pos + 16, 4);
+        pos += 20;
+        if (name_length > m_size - pos || offset > m_size || offset % 8 != 0 || (uint64_t) rows*cols > (m_size - offset) / 8) break;
+        m_index[std::string(base + pos, name_length)] = {rows, cols, (const double*) (base + offset)};
+        pos += name_length;
+    }
+
+    // Sources
+    bool sources = m_index.size() == nmatrices;
+    for (std::string* source: {&m_folder, &m_migration_file}){
+        uint32_t length;
+        if (!sources || m_size - pos < 4){ sources = false; break; }
+        std::memcpy(&length, base + pos, 4);
+        pos += 4;
+        if (length > m_size - pos){ sources = false; break; }
+        *source = std::string(base + pos, length);
+        pos += length;
+    }
+    if (!sources){
+        m_log.error("Efficiency bundle " + filename + " is truncated");
+        m_index.clear();
+        return;
+    }
+    m_valid = true;
+}
+
+
+EfficiencyBundle::~EfficiencyBundle(){
+    if (m_map) munmap(m_map, m_size);
+}
+
+
+bool EfficiencyBundle::Get(std::string name, TMatrixD& m) const {
+    auto it = m_index.find(name);
+    if (it == m_index.end()) return false;
+    const Entry& e = it->second;
+    m.ResizeTo(e.rows, e.cols);
+    for (uint32_t i=0; i<e.rows; i++){
+        for (uint32_t j=0; j<e.cols; j++) m(i, j) = e.data[i*e.cols + j];
+    }
+    return true;
+}
+
+
+std::string EfficiencyBundle::CanonicalPath(std::string path){
+    char resolved[PATH_MAX];
+    if (!realpath(path.c_str(), resolved)) return path;
+    return resolved;
+}
+
+
+bool EfficiencyBundle::Write(std::string filename, const std::vector<std::pair<std::string, TMatrixD>>& matrices, std::string folder, std::string migration_file){
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) return false;
+
+    // Data follows the header, so every offset is a multiple of 8
+    std::vector<uint64_t> offsets;
+    uint64_t offset = header_size;
+    for (auto& m: matrices){
+        offsets.push_back(offset);
+        offset += 8ull * m.second.GetNrows() * m.second.GetNcols();
+    }
+    uint32_t file_version = version;
+    uint32_t nmatrices = matrices.size();
+    out.write(magic, 8);
+    out.write((const char*) &file_version, 4);
+    out.write((const char*) &nmatrices, 4);
+    out.write((const char*) &offset, 8);
+    for (auto& m: matrices){
+        for (int i=0; i<m.second.GetNrows(); i++){
+            for (int j=0; j<m.second.GetNcols(); j++){
+                double value = m.second(i, j);
+                out.write((const char*) &value, 8);
+            }
+        }
+    }
+
+    // Index
+    for (unsigned int k=0; k<matrices.size(); k++){
+        uint32_t rows = matrices[k].second.GetNrows();
+        uint32_t cols = matrices[k].second.GetNcols();
+        uint32_t name_length = matrices[k].first.size();
+        out.write((const char*) &rows, 4);
+        out.write((const char*) &cols, 4);
+        out.write((const char*) &offsets[k], 8);
+        out.write((const char*) &name_length, 4);
+        out.write(matrices[k].first.data(), name_length);
+    }
+
+    // Sources
+    for (std::string source: {CanonicalPath(folder), CanonicalPath(migration_file)}){
+        uint32_t length = source.size();
+        out.write((const char*) &length, 4);
+        out.write(source.data(), length);
+    }
+    out.close();
+    return out.good();
+}
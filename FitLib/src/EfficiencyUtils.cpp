@@ -3,154 +3,301 @@
 #include "TH2F.h"
 
 #include <fstream>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <string>
 #include <sstream>
 
 namespace EfficiencyUtils {
-    
-    TMatrixD GetMigrationMatrix(){
-        TFile file("/home/mackay/bes3_deltaKPi/misc/migration/new_single_migration_matrices.root");
+
+    namespace {
+
+        /**
+         * Process-wide matrix caches, one per matrix size. An entry is added
+         * when its matrix starts loading, so other threads wait for that load
+         * instead of reading the file again, and loads of other matrices are
+         * not held up by the lock.
+        */
+        std::mutex cache_mutex;
+        template <int N>
+        using CacheEntry = std::shared_future<std::shared_ptr<const CachedMatrix<N>>>;
+        template <int N>
+        std::map<MatrixKey, CacheEntry<N>>& Cache(){
+            static std::map<MatrixKey, CacheEntry<N>> cache;
+            return cache;
+        }
+
+        /** Matrices set in place of the files, unfolding matrices by file path */
+        std::shared_ptr<const CachedMigration> migration_override;
+        std::map<std::string, std::shared_ptr<const CachedUnfolding>> unfolding_overrides;
+
+        /**
+         * Unfolding matrix set in place of a file
+         * @param filename path of the file
+        */
+        std::shared_ptr<const CachedUnfolding> UnfoldingOverride(std::string filename){
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            auto it = unfolding_overrides.find(filename);
+            return (it != unfolding_overrides.end()) ? it->second : nullptr;
+        }
+
+        /**
+         * Matrix from the cache, loaded and decomposed on the first call
+         * @param key key of the matrix
+         * @param load function loading the matrix
+        */
+        template <int N>
+        std::shared_ptr<const CachedMatrix<N>> Lookup(const MatrixKey& key, std::function<TMatrixD()> load){
+            std::promise<std::shared_ptr<const CachedMatrix<N>>> loaded;
+            CacheEntry<N> entry;
+            bool first = false;
+            {
+                std::lock_guard<std::mutex> lock(cache_mutex);
+                auto& cache = Cache<N>();
+                auto it = cache.find(key);
+                if (it != cache.end()) entry = it->second;
+                else{
+                    entry = loaded.get_future().share();
+                    cache[key] = entry;
+                    first = true;
+                }
+            }
+            if (first){
+                auto matrix = std::make_shared<const CachedMatrix<N>>(load());
+                if (matrix->lu.Singular()) Log("EfficiencyUtils").warning(("Singular " + key.kind + " matrix " + key.tag).c_str());
+                loaded.set_value(matrix);
+            }
+            return entry.get();
+        }
+
+        /** Mapped efficiency bundles */
+        std::mutex bundle_mutex;
+        std::map<std::string, std::shared_ptr<const EfficiencyBundle>> bundles;
+
+        /**
+         * Load a matrix from the bundle, or from its file if the bundle doesn't have it
+         * or was packed from another folder (or migration file)
+         * @param bundle efficiency bundle (can be null)
+         * @param source folder of the file, or the migration file
+         * @param name name of the matrix in the bundle
+         * @param n number of rows and columns of the matrix
+         * @param read function reading the file
+        */
+        TMatrixD LoadMatrix(std::shared_ptr<const EfficiencyBundle> bundle, std::string source, std::string name, int n, std::function<TMatrixD()> read){
+            TMatrixD m;
+            if (!bundle) return read();
+            const std::string& packed = (name == "migMatrix") ? bundle->MigrationFile() : bundle->Folder();
+            if (EfficiencyBundle::CanonicalPath(source) != packed){
+                Log("EfficiencyUtils").warning(("Efficiency bundle was packed from " + packed + ", reading " + name + " from " + source).c_str());
+                return read();
+            }
+            if (bundle->Get(name, m) && m.GetNrows() == n && m.GetNcols() == n) return m;
+            Log("EfficiencyUtils").warning(("Efficiency bundle has no " + std::to_string(n) + "x" + std::to_string(n) + " " + name + ", reading the file").c_str());
+            return read();
+        }
+
+    }
+
+
+    TMatrixD ReadUnfoldingFile(std::string filename){
+        std::ifstream input_file(filename);
+        if (!input_file.is_open()){
+            Log("EfficiencyUtils").error("Can't open unfolding matrix " + filename);
+            exit(1);
+        }
+        std::string line, value;
+        TMatrixD unfolding_matrix(EfficiencyUtils::nprods, EfficiencyUtils::nprods);
+        int row_counter = 0;
+        while(getline(input_file, line)){
+            std::stringstream ss(line);
+            int col_counter = 0;
+            while(getline(ss, value, ' ')){
+                unfolding_matrix(row_counter, col_counter) = std::stod(value) / 100;
+                col_counter += 1;
+            }
+            row_counter += 1;
+        }
+        input_file.close();
+        return unfolding_matrix;
+    }
+
+
+    TMatrixD ReadMigrationFile(std::string filename){
+        TFile file(filename.c_str());
         TH2F* migration = (TH2F*) file.Get("migMatrix");
+        if (!migration){
+            Log("EfficiencyUtils").error("No migMatrix in " + filename);
+            exit(1);
+        }
         TMatrixD m(EfficiencyUtils::nbins, EfficiencyUtils::nbins);
         for (int i=0; i<EfficiencyUtils::nbins; i++){
-            for (int j=0; j<EfficiencyUtils::nbins; j++){
-                if(i != EfficiencyUtils::nbins) m(j,i) = migration->GetBinContent(i+1, j+1);
-            }
+            for (int j=0; j<EfficiencyUtils::nbins; j++) m(j,i) = migration->GetBinContent(i+1, j+1);
         }
-    return m;
+        return m;
+    }
+
+
+    std::shared_ptr<const EfficiencyBundle> GetBundle(Settings s){
+        if (!s.key_exists("efficiency_bundle")) return nullptr;
+        std::string filename = s.get("efficiency_bundle");
+        std::lock_guard<std::mutex> lock(bundle_mutex);
+        auto it = bundles.find(filename);
+        if (it != bundles.end()) return it->second;
+        auto bundle = std::make_shared<const EfficiencyBundle>(filename);
+        if (!bundle->Valid()) bundle = nullptr;
+        bundles[filename] = bundle;
+        return bundle;
+    }
+
+
+    std::shared_ptr<const CachedMigration> CachedMigrationMatrix(Settings s){
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            if (migration_override) return migration_override;
+        }
+        auto bundle = GetBundle(s);
+        std::string bundle_name = bundle ? s.get("efficiency_bundle") : "";
+        return Lookup<nbins>({"migration", "", migration_file, "", -1, bundle_name}, [bundle](){
+            return LoadMatrix(bundle, migration_file, "migMatrix", nbins, [](){ return ReadMigrationFile(migration_file); });
+        });
+    }
+
+
+    void SetMigrationMatrix(const TMatrixD& m){
+        auto entry = std::make_shared<const CachedMigration>(m);
+        if (entry->lu.Singular()) Log("EfficiencyUtils").warning("Singular migration matrix set");
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        migration_override = entry;
+        return;
+    }
+
+
+    void SetUnfoldingMatrix(std::string folder, std::string name, const TMatrixD& m){
+        auto entry = std::make_shared<const CachedUnfolding>(m);
+        if (entry->lu.Singular()) Log("EfficiencyUtils").warning(("Singular unfolding matrix " + folder + name + " set").c_str());
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        unfolding_overrides[folder + name] = entry;
+        return;
     }
-    
+
+
+    std::string UnfoldingFolder(Settings s, bool kspipi){
+        if (!s.key_exists("efficiency_folder")) return EfficiencyUtils::input_dir + "default/";
+        if (kspipi) return s.get("efficiency_folder");
+        return EfficiencyUtils::input_dir + s.get("efficiency_folder") + "/";
+    }
+
+
+    void ClearMatrixCache(){
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        migration_override = nullptr;
+        unfolding_overrides.clear();
+        Cache<nbins>().clear();
+        Cache<nprods>().clear();
+        return;
+    }
+
 
     std::map<int, double> ReverseMigration(std::map<int, double> Ni){
 
-        // Conver map to TVector
-        TVectorD input_yields(EfficiencyUtils::nbins);
+        // Conver map to vector
+        BinVector input_yields;
         unsigned int i = 0;
-        for (auto key: Ni) input_yields(i) = key.second; i++;
+        for (auto key: Ni){ input_yields(i) = key.second; i++; }
 
         // Migrate
-        input_yields *= GetMigrationMatrix();
+        input_yields = CachedMigrationMatrix()->Fold(input_yields);
 
         // Convert back to map
         i = 0;
         std::map<int, double> migrated_Ni;
-        for (auto key: Ni) migrated_Ni.insert( {key.first, input_yields(i)} ); i++;
+        for (auto key: Ni){ migrated_Ni.insert( {key.first, input_yields(i)} ); i++; }
 
         return migrated_Ni;
 
     }
-    
+
 
     std::map<int, double> Migration(std::map<int, double> Ni){
 
-        // Convert map to TVector
-        TVectorD input_yields(EfficiencyUtils::nbins);
+        // Convert map to vector
+        BinVector input_yields;
         unsigned int i = 0;
-        for (auto key: Ni) input_yields(i) = key.second; i++;
+        for (auto key: Ni){ input_yields(i) = key.second; i++; }
 
         // Migrate
-        input_yields = GetMigrationMatrix().Invert() * input_yields;
-        
-        // Convert TVector to map
+        input_yields = CachedMigrationMatrix()->Unfold(input_yields);
+
+        // Convert vector to map
         i = 0;
         std::map<int, double> migrated_Ni;
-        for (auto key: Ni) migrated_Ni.insert( {key.first, input_yields(i)} ); i++;
-        
+        for (auto key: Ni){ migrated_Ni.insert( {key.first, input_yields(i)} ); i++; }
+
         return migrated_Ni;
     }
-    
 
-    TMatrixD GetUnfoldingMatrix(int bin, Settings s){
+
+    std::shared_ptr<const CachedUnfolding> CachedUnfoldingMatrix(int bin, Settings s){
 
         // Get folder containing effs
-        std::string folder;
-        if (s.key_exists("efficiency_folder")) folder = s.get("efficiency_folder");
-        else folder = EfficiencyUtils::input_dir + "default/";
+        std::string folder = UnfoldingFolder(s, true);
+
+        // Toy seed and systematic
+        int seed = -1;
+        if (s.key_exists("toy") && s.getB("toy") && s.key_exists("seed")) seed = s.getI("seed");
+        std::string ender = "";
+        if (s.key_exists("unfolding_systematic") && s.getB("unfolding_systematic")) ender = s.get("systematic_file_ender");
 
-        // Parse input filename
+        // Parse input filename; toy files carry the seed as a double (e.g. _5.000000)
         std::string init_filename = folder + "KSPiPi_vs_KPi";
-        if (s.getB("toy") & s.key_exists("seed")){
-            init_filename += "_" + std::to_string(s.getI("seed")) + "FTbin" + std::to_string(abs(bin));
-        }        
-        std::string file_ender = "FTbin" + std::to_string(abs(bin));
-        if (s.getB("unfolding_systematic")) file_ender += s.get("systematic_file_ender");        
-        std::string filename = init_filename + file_ender + ".txt";
-
-        // Load matrix        
-        std::ifstream input_file(filename);
-        std::string line, value;
-        TMatrixD unfolding_matrix(EfficiencyUtils::nprods, EfficiencyUtils::nprods);
-        int row_counter = 0;
-        while(getline(input_file, line)){
-            std::stringstream ss(line);
-            int col_counter = 0;
-            while(getline(ss, value, ' ')){
-                unfolding_matrix(row_counter, col_counter) = std::stod(value) / 100;
-                col_counter += 1;
-            }
-            row_counter += 1;
-        }
-        input_file.close();
+        if (seed >= 0) init_filename += "_" + std::to_string((double) seed) + "FTbin" + std::to_string(abs(bin));
+        std::string filename = init_filename + "FTbin" + std::to_string(abs(bin)) + ender + ".txt";
 
-        return unfolding_matrix;
+        auto bundle = GetBundle(s);
+        std::string bundle_name = bundle ? s.get("efficiency_bundle") : "";
+        std::string name = filename.substr(filename.find_last_of('/') + 1);
+        if (auto unfolding = UnfoldingOverride(filename)) return unfolding;
+        return Lookup<nprods>({"unfolding", std::to_string(abs(bin)), folder, ender, seed, bundle_name}, [bundle, folder, name, filename](){
+            return LoadMatrix(bundle, folder, name, nprods, [filename](){ return ReadUnfoldingFile(filename); });
+        });
     }
-    
-    
-    TMatrixD GetUnfoldingMatrix(std::string tag, Settings s){
-        
-        // Get folder name
-        std::string folder;
-        if (s.key_exists("efficiency_folder")) folder = EfficiencyUtils::input_dir + s.get("efficiency_folder") + "/";
-        else folder = EfficiencyUtils::input_dir + "default/";
 
-        // Parse filename    
-        std::string init_filename = folder + tag + "_vs_KPi";
-        std::string file_ender = "";
-        if (s.getB("unfolding_systematic")) file_ender += s.get("systematic_file_ender");
-        std::string filename = init_filename + file_ender + ".txt";
 
-        // Load matrix        
-        std::ifstream input_file(filename);
-        std::string line, value;
-        TMatrixD unfolding_matrix(EfficiencyUtils::nprods, EfficiencyUtils::nprods);
-        int row_counter = 0;
-        while(getline(input_file, line)){
-            std::stringstream ss(line);
-            int col_counter = 0;
-            while(getline(ss, value, ' ')){
-                unfolding_matrix(row_counter, col_counter) = std::stod(value) / 100;
-                col_counter += 1;
-            }
-            row_counter += 1;
-        }
-        input_file.close();
+    std::shared_ptr<const CachedUnfolding> CachedUnfoldingMatrix(std::string tag, Settings s){
 
-        return unfolding_matrix;
+        // Get folder name
+        std::string folder = UnfoldingFolder(s, false);
+
+        // Parse filename
+        std::string ender = "";
+        if (s.key_exists("unfolding_systematic") && s.getB("unfolding_systematic")) ender = s.get("systematic_file_ender");
+        std::string filename = folder + tag + "_vs_KPi" + ender + ".txt";
+
+        auto bundle = GetBundle(s);
+        std::string bundle_name = bundle ? s.get("efficiency_bundle") : "";
+        std::string name = filename.substr(filename.find_last_of('/') + 1);
+        if (auto unfolding = UnfoldingOverride(filename)) return unfolding;
+        return Lookup<nprods>({"unfolding", tag, folder, ender, -1, bundle_name}, [bundle, folder, name, filename](){
+            return LoadMatrix(bundle, folder, name, nprods, [filename](){ return ReadUnfoldingFile(filename); });
+        });
     }
-    
-    
+
+
     TVectorD FoldYields(TVectorD yields_by_prod, int bin, Settings s){
-        TMatrixD unfolding_matrix = GetUnfoldingMatrix(abs(bin), s);
-        yields_by_prod *= unfolding_matrix;
-        return yields_by_prod;
+        return CachedUnfoldingMatrix(abs(bin), s)->Fold(ProdVector::FromTVector(yields_by_prod)).ToTVector();
     }
-    
+
     TVectorD FoldYields(TVectorD yields_by_prod, std::string tag, Settings s){
-        TMatrixD unfolding_matrix = GetUnfoldingMatrix(tag, s);
-        yields_by_prod *= unfolding_matrix;
-        return yields_by_prod;
+        return CachedUnfoldingMatrix(tag, s)->Fold(ProdVector::FromTVector(yields_by_prod)).ToTVector();
     }
-    
+
     TVectorD UnfoldYields(TVectorD yields_by_prod, int bin, Settings s){
-        TMatrixD unfolding_matrix = GetUnfoldingMatrix(abs(bin), s);
-        yields_by_prod *= unfolding_matrix.Invert();
-        return yields_by_prod;
+        return CachedUnfoldingMatrix(abs(bin), s)->Unfold(ProdVector::FromTVector(yields_by_prod)).ToTVector();
     }
-    
+
     TVectorD UnfoldYields(TVectorD yields_by_prod, std::string tag, Settings s){
-        TMatrixD unfolding_matrix = GetUnfoldingMatrix(tag, s);
-        yields_by_prod *= unfolding_matrix.Invert();
-        return yields_by_prod;
+        return CachedUnfoldingMatrix(tag, s)->Unfold(ProdVector::FromTVector(yields_by_prod)).ToTVector();
     }
 
-}
\ No newline at end of file
+}
@@ -35,12 +35,16 @@ void FitModel::AddSignal(){
         if (m_settings.getB("smear_signal")){
             if (m_debug){ m_log.debug("Convolving the KDE with Gaussian"); }
             RooRealVar* kpi_smear_width = new RooRealVar(m_prename + "kpi_smear_width", "", 0.003, 1e-4, 0.01);
+            Register(kpi_smear_width, ParameterRegistry::Shape, "signal");
             RooRealVar* kpi_smear_mean = new RooRealVar(m_prename + "kpi_smear_mean", "", -0.001, -0.003, 0.003);
+            Register(kpi_smear_mean, ParameterRegistry::Shape, "signal");
             RooGaussian* kpi_smear = new RooGaussian(m_prename + "kpi_smear", "", *m_vars->m_kpi, *kpi_smear_mean, *kpi_smear_width);
             kpi_signal_shape = new RooFFTConvPdf(m_prename + "kpi_signal_shape", "", *m_vars->m_kpi, *kpi_kde, *kpi_smear);
             
             RooRealVar* tag_smear_width = new RooRealVar(m_prename + "tag_smear_width", "", 0.003, 1e-4, 0.01);
+            Register(tag_smear_width, ParameterRegistry::Shape, "signal");
             RooRealVar* tag_smear_mean = new RooRealVar(m_prename + "tag_smear_mean", "", -0.001, -0.003, 0.003);
+            Register(tag_smear_mean, ParameterRegistry::Shape, "signal");
             RooGaussian* tag_smear = new RooGaussian(m_prename + "tag_smear", "", *m_vars->m_tag, *tag_smear_mean, *tag_smear_width);            
             tag_signal_shape = new RooFFTConvPdf(m_prename + "tag_signal_shape", "", *m_vars->m_tag, *tag_kde, *tag_smear);
         }
@@ -58,7 +62,11 @@ void FitModel::AddSignal(){
     // Yield
     RooAbsReal* n_signal;
     if (m_settings.key_exists("Yi_strategy")) n_signal = m_vars->Ni[m_settings.get("prod")][m_settings.getI("bin_number")];
-    else{ n_signal = new RooRealVar(m_prename + "n_signal", "", 100, 0, 2800); }
+    else{
+        RooRealVar* n_signal_var = new RooRealVar(m_prename + "n_signal", "", 100, 0, 2800);
+        Register(n_signal_var, ParameterRegistry::Physics, "signal");
+        n_signal = n_signal_var;
+    }
     component_yields.add(*n_signal);
 
     // Make struct
@@ -81,10 +89,12 @@ void FitModel::AddKpiVsComb(){
         }
         else if (m_settings.getB("expo_bkgs")){
             RooRealVar* exponent = new RooRealVar(m_prename + "kpi_vs_comb_exponent", "", -4, -50, 4);
+            Register(exponent, ParameterRegistry::Shape, "kpi_vs_comb", true);
             kpi_vs_comb_comb_shape = new RooExponential(m_prename + "kpi_vs_comb_comb_shape", "", *m_vars->m_tag, *exponent);
         }
         else{
             RooRealVar* exponent = new RooRealVar(m_prename + "kpi_vs_comb_exponent", "", -0.4, -1.0, 0.2);
+            Register(exponent, ParameterRegistry::Shape, "kpi_vs_comb", true);
             kpi_vs_comb_comb_shape = new RooChebychev(m_prename + "kpi_vs_comb_comb_shape", "", *m_vars->m_tag, *exponent);
         }
 
@@ -95,6 +105,7 @@ void FitModel::AddKpiVsComb(){
 
     // Yield
     RooRealVar* n_kpi_vs_comb = new RooRealVar(m_prename + "n_kpi_vs_comb", "", 5, 0, 300);
+    Register(n_kpi_vs_comb, ParameterRegistry::Yield, "kpi_vs_comb");
     component_yields.add(*n_kpi_vs_comb);
 
     // Make struct
@@ -117,10 +128,12 @@ void FitModel::AddCombVsTag(){
         }
         else if (m_settings.getB("expo_bkgs")){
             RooRealVar* exponent = new RooRealVar(m_prename + "comb_vs_tag_exponent", "", -4, -50, 4);
+            Register(exponent, ParameterRegistry::Shape, "comb_vs_tag", true);
             comb_vs_tag_comb_shape = new RooExponential(m_prename + "comb_vs_tag_comb_shape", "", *m_vars->m_kpi, *exponent);
         }
         else{
             RooRealVar* exponent = new RooRealVar(m_prename + "comb_vs_tag_exponent", "", -0.4, -1.0, 0.2);
+            Register(exponent, ParameterRegistry::Shape, "comb_vs_tag", true);
             comb_vs_tag_comb_shape = new RooChebychev(m_prename + "comb_vs_tag_comb_shape", "", *m_vars->m_kpi, *exponent);
         }
         // Product
@@ -131,6 +144,7 @@ void FitModel::AddCombVsTag(){
 
     // Yield
     RooRealVar* n_comb_vs_tag = new RooRealVar(m_prename + "n_comb_vs_tag", "", 5, 0, 300);
+    Register(n_comb_vs_tag, ParameterRegistry::Yield, "comb_vs_tag");
     component_yields.add(*n_comb_vs_tag);
 
     // Make struct
@@ -148,30 +162,38 @@ void FitModel::AddComb(){
     RooAbsPdf* qqbar_kpi_shape;
     if (m_settings.getB("kpi_expo_qqbar")){
         RooRealVar* qqbar_kpi_exponent = new RooRealVar(m_prename + "qqbar_kpi_exponent", "", -4, -50, 4);
+        Register(qqbar_kpi_exponent, ParameterRegistry::Shape, "flat_qqbar", true);
         qqbar_kpi_shape = new RooExponential(m_prename + "qqbar_kpi_shape", "", *m_vars->m_kpi, *qqbar_kpi_exponent);
     }
     else if (m_settings.getB("kpi_cheb2_qqbar")){
         RooRealVar* qqbar_kpi_c0 = new RooRealVar(m_prename + "qqbar_kpi_c0", "", -0.4, -1.0, 1.0);
+        Register(qqbar_kpi_c0, ParameterRegistry::Shape, "flat_qqbar");
         RooRealVar* qqbar_kpi_c1 = new RooRealVar(m_prename + "qqbar_kpi_c1", "", 0.1, -1.0, 1.0);
+        Register(qqbar_kpi_c1, ParameterRegistry::Shape, "flat_qqbar");
         qqbar_kpi_shape = new RooChebychev(m_prename + "qqbar_kpi_shape", "", *m_vars->m_kpi, RooArgList(*qqbar_kpi_c0, *qqbar_kpi_c1));
     }
     else{
         RooRealVar* qqbar_kpi_exponent = new RooRealVar(m_prename + "qqbar_kpi_exponent", "", -0.4, -1.0, 0.2);
+        Register(qqbar_kpi_exponent, ParameterRegistry::Shape, "flat_qqbar", true);
         qqbar_kpi_shape = new RooChebychev(m_prename + "qqbar_kpi_shape", "", *m_vars->m_kpi, *qqbar_kpi_exponent);
     }
 
     RooAbsPdf* qqbar_tag_shape;
     if (m_settings.getB("tag_expo_qqbar")){
         RooRealVar* qqbar_tag_exponent = new RooRealVar(m_prename + "qqbar_tag_exponent", "", -4, -50, 4);
+        Register(qqbar_tag_exponent, ParameterRegistry::Shape, "flat_qqbar", true);
         qqbar_tag_shape = new RooExponential(m_prename + "qqbar_tag_shape", "", *m_vars->m_tag, *qqbar_tag_exponent);
     }
     else if (m_settings.getB("tag_cheb2_qqbar")){
         RooRealVar* qqbar_tag_c0 = new RooRealVar(m_prename + "qqbar_tag_c0", "", -0.4, -1.0, 0.5);
+        Register(qqbar_tag_c0, ParameterRegistry::Shape, "flat_qqbar");
         RooRealVar* qqbar_tag_c1 = new RooRealVar(m_prename + "qqbar_tag_c1", "", 0., -1.0, 1.0);
+        Register(qqbar_tag_c1, ParameterRegistry::Shape, "flat_qqbar");
         qqbar_tag_shape = new RooChebychev(m_prename + "qqbar_tag_shape", "", *m_vars->m_tag, RooArgList(*qqbar_tag_c0, *qqbar_tag_c1));
     }
     else{
         RooRealVar* qqbar_tag_exponent = new RooRealVar(m_prename + "qqbar_tag_exponent", "", -0.1, -1.0, 0.2);
+        Register(qqbar_tag_exponent, ParameterRegistry::Shape, "flat_qqbar", true);
         qqbar_tag_shape = new RooChebychev(m_prename + "qqbar_tag_shape", "", *m_vars->m_tag, *qqbar_tag_exponent);
     }
 
@@ -181,6 +203,7 @@ void FitModel::AddComb(){
 
     // Yield
     RooRealVar* n_qqbar = new RooRealVar(m_prename + "n_flat_qqbar", "", 25, 0., 5000);
+    Register(n_qqbar, ParameterRegistry::Yield, "flat_qqbar");
     component_yields.add(*n_qqbar);
     
     // Make struct
@@ -205,11 +228,13 @@ void FitModel::AddKPiVsKPiPi0(){
     if (m_settings.key_exists("kpi_vs_kpipi0_rate")){
         if (m_debug){ m_log.debug(("Fixing the Kpi vs Kpipi0 yield to be " + std::to_string(m_settings.getD("kpi_vs_kpipi0_rate")) + " of the signal yield").c_str()); }
         RooRealVar* kpi_vs_kpipiz_rate = new RooRealVar(m_prename + "kpi_vs_kpipi0_rate", "", m_settings.getD("kpi_vs_kpipi0_rate"));
+        Register(kpi_vs_kpipiz_rate, ParameterRegistry::Nuisance, "kpi_vs_kpipi0");
         kpi_vs_kpipiz_rate->setConstant();
         n_kpi_vs_kpipiz = new RooFormulaVar(m_prename + "n_kpi_vs_kpipi0", "@0 * @1", RooArgList(*kpi_vs_kpipiz_rate, *components["signal"].yield));
     }
     else{
         n_kpi_vs_kpipiz = new RooRealVar(m_prename + "n_kpi_vs_kpipi0", "", 120, 0, 500);
+        Register(n_kpi_vs_kpipiz, ParameterRegistry::Yield, "kpi_vs_kpipi0");
     }
     component_yields.add(*n_kpi_vs_kpipiz);
 
@@ -230,7 +255,9 @@ void FitModel::AddCorrelatedQQBar(){
         double starting_mean = 3.92;
         if (m_settings.key_exists("starting_qqbar_mean")) starting_mean = m_settings.getD("starting_qqbar_mean");
         RooRealVar* qqbar_sigma = new RooRealVar(m_prename + "qqbar_sigma","", 0.015, 0., 0.180);
+        Register(qqbar_sigma, ParameterRegistry::Shape, "correlated_qqbar");
         RooRealVar* qqbar_mean = new RooRealVar(m_prename + "qqbar_mean","", starting_mean, 3.30, 4.20);
+        Register(qqbar_mean, ParameterRegistry::Shape, "correlated_qqbar");
         qqbar_shape = new RooGenericPdf(m_prename + "correlated_qqbar", "exp(-0.5*pow(((@0+@1)-@3)/@2, 2))", RooArgSet(*m_vars->m_kpi, *m_vars->m_tag, *qqbar_sigma, *qqbar_mean));
     }
     component_pdfs.add(*qqbar_shape);
@@ -257,6 +284,7 @@ void FitModel::AddCorrelatedQQBar(){
     
     // Yield
     RooRealVar* n_qqbar = new RooRealVar(m_prename + "n_correlated_qqbar", "", 50, 0., 3000);
+    Register(n_qqbar, ParameterRegistry::Yield, "correlated_qqbar");
     component_yields.add(*n_qqbar);
 
     // Make struct
@@ -282,11 +310,13 @@ void FitModel::AddKPiVsKPi(){
     if (m_settings.key_exists("kpi_vs_kpi_rate")){
         if (m_debug){ m_log.debug(("Fixing the Kpi vs Kpi yield to be " + std::to_string(m_settings.getD("kpi_vs_kpi_rate")) + " of the signal yield").c_str()); }
         RooRealVar* kpi_vs_kpi_rate = new RooRealVar(m_prename + "kpi_vs_kpi_rate", "", m_settings.getD("kpi_vs_kpi_rate"));
+        Register(kpi_vs_kpi_rate, ParameterRegistry::Nuisance, "kpi_vs_kpi");
         kpi_vs_kpi_rate->setConstant();
         n_kpi_vs_kpi = new RooFormulaVar(m_prename + "n_kpi_vs_kpi", "@0 * @1", RooArgList(*kpi_vs_kpi_rate, *components["signal"].yield));
     }
     else{
         n_kpi_vs_kpi = new RooRealVar(m_prename + "n_kpi_vs_kpi", "", 120, 0, 500);
+        Register(n_kpi_vs_kpi, ParameterRegistry::Yield, "kpi_vs_kpi");
     }
     component_yields.add(*n_kpi_vs_kpi);
 
@@ -306,6 +336,7 @@ void FitModel::AddDSTpDSTm(){
 
     // Yield
     RooRealVar* n_dstpdstm = new RooRealVar(m_prename + "n_dstpdstm", "", dstpsdstm_yields.getD(m_settings.get("cat_label")));
+    Register(n_dstpdstm, ParameterRegistry::Yield, "dstpdstm");
     n_dstpdstm->setConstant(true);
     component_yields.add(*n_dstpdstm);
     component_pdfs.add(*signal_shape);
@@ -336,6 +367,7 @@ void FitModel::AddDSTpDm(){
     Settings dstpdm_yields("inputs/DSTpDm.txt");
     dstpdm_yields.read();
     RooRealVar* n_dstpdm = new RooRealVar(m_prename + "n_dstpdm", "", dstpdm_yields.getD(m_settings.get("cat_label")));
+    Register(n_dstpdm, ParameterRegistry::Yield, "dstpdm");
     n_dstpdm->setConstant(true);
     component_yields.add(*n_dstpdm);
     component_pdfs.add(*dstpdm_shape);
@@ -0,0 +1,272 @@
+#include "FitPipeline.hpp"
+#include "TextFileUtils.hpp"
+#include "FitResultUtils.hpp"
+
+#include "RooGlobalFunc.h"
+#include "RooMinimizer.h"
+#include "Math/Factory.h"
+#include "Math/Functor.h"
+#include "Math/Minimizer.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace {
+
+    /** Settings read by every pipeline, interned once */
+    const Settings::Key key_fit_stages = Settings::Intern("fit_stages");
+
+}
+
+FitPipeline::FitPipeline(Settings settings, Variables* vars, std::vector<Stage> defaults, bool debug){
+    m_settings = settings;
+    m_vars = vars;
+    m_debug = debug;
+    m_log = Log("FitPipeline");
+
+    // Stages, with the defaults of the fitter for the stages it knows
+    std::vector<std::string> names;
+    if (m_settings.key_exists(key_fit_stages)) names = TextFileUtils::SplitList(m_settings.get(key_fit_stages));
+    else for (auto stage: defaults) names.push_back(stage.name);
+    for (auto name: names){
+        Stage stage;
+        stage.name = name;
+        for (auto d: defaults) if (d.name == name) stage = d;
+        ReadStage(stage);
+        m_stages.push_back(stage);
+        if (m_debug) m_log.debug(("Stage " + name + (stage.minos ? " with MINOS" : "") + (stage.skip_if.empty() ? "" : ", skipped if " + stage.skip_if)).c_str());
+    }
+
+    // Parameters fixed by the model never float
+    for (int role=0; role<ParameterRegistry::NRoles; role++){
+        for (auto p: m_vars->registry.Get((ParameterRegistry::Role) role)){
+            if (p->isConstant()) m_locked.insert(p);
+        }
+    }
+}
+
+
+void FitPipeline::ReadStage(Stage& stage){
+    std::string key = "stage_" + stage.name + "_";
+
+    if (m_settings.key_exists(key + "minimizer")){
+        auto minimizer = TextFileUtils::SplitList(m_settings.get(key + "minimizer"));
+        stage.minimizer = minimizer.size() > 0 ? minimizer[0] : "";
+        stage.algorithm = minimizer.size() > 1 ? minimizer[1] : "";
+    }
+    if (m_settings.key_exists(key + "strategy")) stage.strategy = m_settings.getI(key + "strategy");
+    if (m_settings.key_exists(key + "ncpu")) stage.ncpu = m_settings.getI(key + "ncpu");
+    if (m_settings.key_exists(key + "minos")){
+        auto minos = TextFileUtils::SplitList(m_settings.get(key + "minos"));
+        stage.minos = minos.size() > 0 && minos[0] == "true";
+    }
+
+    // Roles that float
+    if (m_settings.key_exists(key + "float")){
+        stage.floating.clear();
+        for (auto name: TextFileUtils::SplitList(m_settings.get(key + "float"))){
+            if (name == "all"){
+                for (int role=0; role<ParameterRegistry::NRoles; role++) stage.floating.push_back((ParameterRegistry::Role) role);
+                continue;
+            }
+            ParameterRegistry::Role role = ParameterRegistry::RoleFromString(name);
+            if (role == ParameterRegistry::NRoles) m_log.warning(("Stage " + stage.name + ": unknown role " + name).c_str());
+            else stage.floating.push_back(role);
+        }
+    }
+
+    // Checks and skip condition
+    if (m_settings.key_exists(key + "checks")){
+        stage.checks.clear();
+        for (auto check: TextFileUtils::SplitList(m_settings.get(key + "checks"))){
+            if (check != "yields" && check != "slopes") m_log.warning(("Stage " + stage.name + ": unknown check " + check).c_str());
+            else stage.checks.push_back(check);
+        }
+    }
+    if (m_settings.key_exists(key + "skip_if")){
+        auto skip_if = TextFileUtils::SplitList(m_settings.get(key + "skip_if"));
+        stage.skip_if = skip_if.size() > 0 ? skip_if[0] : "";
+        if (stage.skip_if == "never") stage.skip_if = "";
+        if (!stage.skip_if.empty() && stage.skip_if != "unchanged"){
+            m_log.warning(("Stage " + stage.name + ": unknown skip condition " + stage.skip_if + ", the stage will always run").c_str());
+            stage.skip_if = "";
+        }
+    }
+    return;
+}
+
+
+int FitPipeline::Find(std::string name) const {
+    for (unsigned int i=0; i<m_stages.size(); i++){
+        if (m_stages[i].name == name) return i;
+    }
+    return -1;
+}
+
+
+bool FitPipeline::Skip(const Stage& stage) const {
+    if (stage.skip_if == "unchanged") return !m_changed;
+    return false;
+}
+
+
+bool FitPipeline::FixedShape(const Stage& stage) const {
+    for (auto role: stage.floating){
+        if (role != ParameterRegistry::Physics) return false;
+    }
+    return true;
+}
+
+
+void FitPipeline::Prepare(const Stage& stage){
+    m_floated.clear();
+    for (int role=0; role<ParameterRegistry::NRoles; role++){
+        bool floating = std::find(stage.floating.begin(), stage.floating.end(), role) != stage.floating.end();
+        for (auto p: m_vars->registry.Get((ParameterRegistry::Role) role)){
+            if (m_locked.count(p) > 0) continue;
+            p->setConstant(!floating);
+            if (floating) m_floated.push_back(p);
+        }
+    }
+    return;
+}
+
+
+bool FitPipeline::Update(){
+    bool fixed = false;
+    for (auto p: m_floated){
+        if (!p->isConstant() || m_locked.count(p) > 0) continue;
+        m_locked.insert(p);
+        fixed = true;
+    }
+    if (fixed) m_changed = true;
+    return fixed;
+}
+
+
+RooFitResult* FitPipeline::Fit(RooAbsPdf& pdf, RooAbsData& data, const Stage& stage, bool minos, long& nll_evals){
+    std::unique_ptr<RooAbsReal> nll;
+    if (stage.ncpu > 1) nll.reset(pdf.createNLL(data, RooFit::Extended(true), RooFit::NumCPU(stage.ncpu)));
+    else nll.reset(pdf.createNLL(data, RooFit::Extended(true)));
+    return Minimise(*nll, stage, minos, nll_evals);
+}
+
+
+void FitPipeline::SeedCovariance(const std::vector<std::string>& names, const TMatrixDSym& covariance){
+    m_seed_names = names;
+    m_seed_covariance.ResizeTo(covariance.GetNrows(), covariance.GetNcols());
+    m_seed_covariance = covariance;
+    return;
+}
+
+
+RooFitResult* FitPipeline::Minimise(RooAbsReal& nll, const Stage& stage, bool minos, long& nll_evals){
+    if (!m_seed_names.empty()){
+        if (stage.minimizer.empty() || stage.minimizer == "Minuit2") return SeededMinimise(nll, stage, minos, nll_evals);
+        m_log.warning(("Stage " + stage.name + " does not use Minuit2, the covariance of the warm start is not used").c_str());
+        m_seed_names.clear();
+    }
+    RooMinimizer minimizer(nll);
+    minimizer.optimizeConst(2);
+    if (stage.strategy >= 0) minimizer.setStrategy(stage.strategy);
+    if (stage.minimizer.empty()) minimizer.migrad();
+    else minimizer.minimize(stage.minimizer.c_str(), stage.algorithm.empty() ? "migrad" : stage.algorithm.c_str());
+    minimizer.hesse();
+    if (minos && stage.minos){
+        if (m_vars->minos_vars.getSize() > 0) minimizer.minos(m_vars->minos_vars);
+        else minimizer.minos();
+    }
+    nll_evals = minimizer.evalCounter();
+    return minimizer.save();
+}
+
+
+RooFitResult* FitPipeline::SeededMinimise(RooAbsReal& nll, const Stage& stage, bool minos, long& nll_evals){
+
+    // Floating parameters of the NLL
+    std::unique_ptr<RooArgSet> nll_pars(nll.getParameters(RooArgSet()));
+    RooArgList pars, const_pars;
+    for (auto arg: *nll_pars){
+        RooRealVar* p = dynamic_cast<RooRealVar*>(arg);
+        if (!p) continue;
+        if (p->isConstant()) const_pars.add(*p);
+        else pars.add(*p);
+    }
+    std::unique_ptr<RooArgList> init_pars((RooArgList*) pars.snapshot());
+    const int n = pars.getSize();
+
+    // Minuit2 on the NLL as a function of the floating parameters
+    long ncalls = 0;
+    ROOT::Math::Functor function([&](const double* x){
+        for (int k=0; k<n; k++) ((RooRealVar*) pars.at(k))->setVal(x[k]);
+        ncalls += 1;
+        return nll.getVal();
+    }, n);
+    std::unique_ptr<ROOT::Math::Minimizer> minimizer(ROOT::Math::Factory::CreateMinimizer("Minuit2", stage.algorithm.empty() ? "Migrad" : stage.algorithm.c_str()));
+    minimizer->SetFunction(function);
+    minimizer->SetErrorDef(nll.defaultErrorLevel());
+    minimizer->SetStrategy(stage.strategy >= 0 ? stage.strategy : 1);
+    minimizer->SetPrintLevel(m_debug ? 1 : -1);
+    for (int k=0; k<n; k++){
+        RooRealVar* p = (RooRealVar*) pars.at(k);
+        double step = (p->getError() > 0) ? p->getError() : 0.01 * (p->getMax() - p->getMin());
+        if (p->hasMin() && p->hasMax()) minimizer->SetLimitedVariable(k, p->GetName(), p->getVal(), step, p->getMin(), p->getMax());
+        else minimizer->SetVariable(k, p->GetName(), p->getVal(), step);
+    }
+
+    // Covariance of the previous fit for the parameters it floated, step sizes for the others
+    std::vector<int> index(n, -1);
+    int nseeded = 0;
+    for (int k=0; k<n; k++){
+        auto found = std::find(m_seed_names.begin(), m_seed_names.end(), pars.at(k)->GetName());
+        if (found == m_seed_names.end()) continue;
+        index[k] = found - m_seed_names.begin();
+        nseeded += 1;
+    }
+    std::vector<double> covariance(n * n, 0.);
+    for (int i=0; i<n; i++){
+        double step = ((RooRealVar*) pars.at(i))->getError();
+        if (index[i] < 0) covariance[i * n + i] = (step > 0) ? step * step : 1e-4;
+        for (int j=0; j<n; j++){
+            if (index[i] >= 0 && index[j] >= 0) covariance[i * n + j] = m_seed_covariance(index[i], index[j]);
+        }
+    }
+    minimizer->SetCovariance(covariance, n);
+    m_seed_names.clear();
+    if (m_debug) m_log.debug(("Seeding MIGRAD with the covariance of " + std::to_string(nseeded) + "/" + std::to_string(n) + " parameters from the warm start").c_str());
+
+    // MIGRAD and HESSE
+    std::vector<std::pair<std::string, int>> history;
+    bool converged = minimizer->Minimize();
+    int status = minimizer->Status();
+    history.push_back({"MIGRAD", status});
+    if (!converged) m_log.warning(("Stage " + stage.name + ": MIGRAD status " + std::to_string(status)).c_str());
+    minimizer->Hesse();
+    history.push_back({"HESSE", minimizer->Status()});
+    for (int k=0; k<n; k++){
+        RooRealVar* p = (RooRealVar*) pars.at(k);
+        p->setVal(minimizer->X()[k]);
+        p->setError(minimizer->Errors()[k]);
+        p->removeAsymError();
+    }
+    TMatrixDSym final_covariance(n);
+    for (int i=0; i<n; i++){
+        for (int j=0; j<n; j++) final_covariance(i, j) = minimizer->CovMatrix(i, j);
+    }
+
+    // MINOS
+    if (minos && stage.minos){
+        for (int k=0; k<n; k++){
+            RooRealVar* p = (RooRealVar*) pars.at(k);
+            if (m_vars->minos_vars.getSize() > 0 && !m_vars->minos_vars.find(p->GetName())) continue;
+            double error_lo = 0, error_hi = 0;
+            bool ok = minimizer->GetMinosError(k, error_lo, error_hi);
+            history.push_back({"MINOS", ok ? 0 : minimizer->MinosStatus()});
+            if (ok) p->setAsymError(error_lo, error_hi);
+            else m_log.warning(TString("MINOS failed for ") + p->GetName());
+        }
+    }
+
+    nll_evals = ncalls;
+    return FitResultUtils::MakeFitResult("fitresult_" + stage.name, *init_pars, pars, const_pars, minimizer->MinValue(), minimizer->Edm(), status, minimizer->CovMatrixStatus(), final_covariance, history);
+}
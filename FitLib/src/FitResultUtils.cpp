@@ -0,0 +1,203 @@
+#include "FitResultUtils.hpp"
+
+#include "RooRealVar.h"
+#include "TFile.h"
+
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <memory>
+
+namespace {
+
+    /**
+     * Fit result with access to the protected setters of RooFitResult
+    */
+    class FitResultBuilder : public RooFitResult {
+    public:
+        FitResultBuilder(const char* name) : RooFitResult(name, "") {}
+        using RooFitResult::setInitParList;
+        using RooFitResult::setFinalParList;
+        using RooFitResult::setConstParList;
+        using RooFitResult::setMinNLL;
+        using RooFitResult::setEDM;
+        using RooFitResult::setStatus;
+        using RooFitResult::setCovQual;
+        void addStatus(std::string label, int status){ _statusHistory.push_back({label, status}); }
+    };
+
+}
+
+
+namespace FitResultUtils {
+
+    std::map<std::string, ParameterState> ReadTextResults(std::string filename){
+        std::map<std::string, ParameterState> states;
+        std::ifstream file(filename);
+        std::string line, section;
+        while (std::getline(file, line)){
+            if (line.empty()) continue;
+            if (line[0] == '*'){ section = line; continue; }
+            std::stringstream ss(line);
+            std::string name;
+            double value;
+            if (!(ss >> name >> value)) continue;
+            if (section.find("Floated parameters") != std::string::npos) states[name].value = value;
+            else if (section.find("Floated parameter errors") != std::string::npos){
+                std::string par = name.substr(0, name.size() - 6);
+                if (name.size() > 6 && name.substr(name.size() - 6) == "_errLo") states[par].error_lo = value;
+                else if (name.size() > 6 && name.substr(name.size() - 6) == "_errHi") states[par].error_hi = value;
+            }
+        }
+        file.close();
+
+        // Symmetric step size from the asymmetric errors
+        for (auto& s: states){
+            if (s.second.error_lo < 0 && s.second.error_hi > 0) s.second.error = 0.5 * (s.second.error_hi - s.second.error_lo);
+        }
+        return states;
+    }
+
+
+    std::map<std::string, ParameterState> ReadBinaryResults(std::string filename){
+        std::map<std::string, ParameterState> states;
+        TFile file(filename.c_str());
+        RooFitResult* result = (RooFitResult*) file.Get("fit_result");
+        if (!result) return states;
+        const RooArgList& fp = result->floatParsFinal();
+        for (int i=0; i < fp.getSize(); i++){
+            RooRealVar* p = (RooRealVar*) fp.at(i);
+            ParameterState s;
+            s.value = p->getVal();
+            s.error = std::sqrt(result->covarianceMatrix()(i, i));
+            s.error_lo = p->hasAsymError() ? p->getErrorLo() : -s.error;
+            s.error_hi = p->hasAsymError() ? p->getErrorHi() : s.error;
+            states[p->GetName()] = s;
+        }
+        delete result;
+        file.Close();
+        return states;
+    }
+
+
+    bool ReadCovariance(std::string filename, std::vector<std::string>& names, TMatrixDSym& covariance){
+        names.clear();
+        if (filename.size() <= 5 || filename.substr(filename.size() - 5) != ".root") return false;
+        TFile file(filename.c_str());
+        RooFitResult* result = (RooFitResult*) file.Get("fit_result");
+        if (!result) return false;
+        const RooArgList& fp = result->floatParsFinal();
+        for (int i=0; i < fp.getSize(); i++) names.push_back(fp.at(i)->GetName());
+        covariance.ResizeTo(fp.getSize(), fp.getSize());
+        covariance = result->covarianceMatrix();
+        bool ok = result->covQual() >= 2;
+        delete result;
+        file.Close();
+        return ok;
+    }
+
+
+    std::map<std::string, ParameterState> ReadSnapshot(std::string filename){
+        if (filename.size() > 5 && filename.substr(filename.size() - 5) == ".root") return ReadBinaryResults(filename);
+        return ReadTextResults(filename);
+    }
+
+
+    int ApplySnapshot(const RooArgSet& pars, const std::map<std::string, ParameterState>& snapshot){
+        int n_set = 0;
+        for (auto arg: pars){
+            RooRealVar* p = dynamic_cast<RooRealVar*>(arg);
+            if (!p || p->isConstant()) continue;
+            auto s = snapshot.find(p->GetName());
+            if (s == snapshot.end()) continue;
+            p->setVal(s->second.value);
+            if (s->second.error > 0) p->setError(s->second.error);
+            n_set += 1;
+        }
+        return n_set;
+    }
+
+
+    void WriteBinaryResults(RooFitResult* result, std::string filename){
+        TFile file(filename.c_str(), "RECREATE");
+        result->Write("fit_result");
+        file.Close();
+        return;
+    }
+
+
+    void WriteCheckpoint(RooFitResult* result, const RooArgSet& pars, std::string filename){
+        std::unique_ptr<RooArgSet> state((RooArgSet*) pars.snapshot());
+        TFile file(filename.c_str(), "RECREATE");
+        result->Write("fit_result");
+        state->Write("parameters");
+        file.Close();
+        return;
+    }
+
+
+    RooFitResult* ReadCheckpoint(const RooArgSet& pars, std::string filename){
+        TFile file(filename.c_str());
+        RooFitResult* result = (RooFitResult*) file.Get("fit_result");
+        std::unique_ptr<RooArgSet> state((RooArgSet*) file.Get("parameters"));
+        file.Close();
+        if (!result || !state) return nullptr;
+        RestoreParameters(pars, *state);
+        return result;
+    }
+
+
+    void RestoreParameters(const RooArgSet& pars, const RooArgSet& state){
+        for (auto arg: pars){
+            RooRealVar* p = dynamic_cast<RooRealVar*>(arg);
+            RooRealVar* saved = p ? dynamic_cast<RooRealVar*>(state.find(p->GetName())) : nullptr;
+            if (!saved) continue;
+            p->setVal(saved->getVal());
+            p->setError(saved->getError());
+            if (saved->hasAsymError()) p->setAsymError(saved->getErrorLo(), saved->getErrorHi());
+            else p->removeAsymError();
+            p->setConstant(saved->isConstant());
+        }
+        return;
+    }
+
+
+    void WriteComparison(RooFitResult* binned, RooFitResult* unbinned, bool integrated, std::string filename){
+        std::ofstream outfile(filename);
+        if (integrated) outfile << "* binned fit: signal shapes averaged over the (m_kpi, m_tag) bins, other PDFs evaluated at the bin centres" << std::endl;
+        else outfile << "* binned fit: PDFs evaluated at the centres of the (m_kpi, m_tag) bins" << std::endl;
+        outfile << "* parameter binned binned_err unbinned unbinned_err diff diff/unbinned_err" << std::endl;
+        outfile << "minNLL_binned " << binned->minNll() << std::endl;
+        outfile << "minNLL_unbinned " << unbinned->minNll() << std::endl;
+        outfile << "\n* Floated parameters:\n";
+        const RooArgList& binned_pars = binned->floatParsFinal();
+        for (int i=0; i < binned_pars.getSize(); i++){
+            RooRealVar* b = (RooRealVar*) binned_pars.at(i);
+            RooRealVar* u = (RooRealVar*) unbinned->floatParsFinal().find(b->GetName());
+            if (!u) continue;
+            double diff = b->getVal() - u->getVal();
+            double pull = (u->getError() > 0) ? diff / u->getError() : 0;
+            outfile << b->GetName() << " " << b->getVal() << " " << b->getError() << " "
+            << u->getVal() << " " << u->getError() << " " << diff << " " << pull << std::endl;
+        }
+        outfile.close();
+        return;
+    }
+
+
+
+    RooFitResult* MakeFitResult(std::string name, const RooArgList& init_pars, const RooArgList& final_pars, const RooArgList& const_pars, double min_nll, double edm, int status, int cov_qual, TMatrixDSym covariance, const std::vector<std::pair<std::string, int>>& history){
+        FitResultBuilder builder(name.c_str());
+        builder.setConstParList(const_pars);
+        builder.setInitParList(init_pars);
+        builder.setFinalParList(final_pars);
+        builder.setMinNLL(min_nll);
+        builder.setEDM(edm);
+        builder.setStatus(status);
+        builder.setCovQual(cov_qual);
+        builder.setCovarianceMatrix(covariance);
+        for (auto step: history) builder.addStatus(step.first, step.second);
+        return new RooFitResult(builder);
+    }
+
+}
@@ -0,0 +1,117 @@
+#include "FitTimer.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+
+void FitTimer::Start(std::string stage, long nll_evals){
+    m_running.push_back({stage, std::chrono::steady_clock::now(), std::clock(), nll_evals, 0, 0});
+    return;
+}
+
+
+void FitTimer::Stop(RooFitResult* r, long nll_evals){
+    if (m_running.empty()) return;
+    Running start = m_running.back();
+    m_running.pop_back();
+    Stage s;
+    s.name = start.name;
+    s.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start.wall).count();
+    s.cpu = double(std::clock() - start.cpu) / CLOCKS_PER_SEC;
+    s.migrad = 0;
+    s.hesse = 0;
+    s.minos = 0;
+    s.nll_evals = (nll_evals >= 0 && start.nll_evals >= 0) ? nll_evals - start.nll_evals : -1;
+    s.nested_evals = start.nested_evals;
+    s.nested_wall = start.nested_wall;
+    if (!m_running.empty()){
+        m_running.back().nested_evals += std::max(s.nll_evals, 0l) + s.nested_evals;
+        m_running.back().nested_wall += s.wall;
+    }
+
+    // Minimiser calls from the status history
+    if (r){
+        for (unsigned int i=0; i<r->numStatusHistory(); i++){
+            std::string label = r->statusLabelHistory(i);
+            if (label == "MIGRAD" || label == "MINIMIZE") s.migrad++;
+            else if (label == "HESSE") s.hesse++;
+            else if (label == "MINOS") s.minos++;
+        }
+    }
+    m_stages.push_back(s);
+    return;
+}
+
+
+void FitTimer::SetCategoryCosts(const std::vector<std::string>& labels, const std::vector<double>& costs, long nevals){
+    m_categories.clear();
+    for (unsigned int i=0; i<labels.size(); i++) m_categories.push_back({labels[i], costs[i]});
+    m_category_evals = nevals;
+    return;
+}
+
+
+void FitTimer::ProfileComponents(std::string category, const std::map<std::string, RooAbsPdf*>& shapes, RooAbsData& data){
+    std::string prefix = category.empty() ? "" : category + "_";
+    for (auto shape: shapes){
+        std::unique_ptr<RooArgSet> obs(shape.second->getObservables(*data.get()));
+        double sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i=0; i<data.numEntries(); i++){
+            obs->assignValueOnly(*data.get(i));
+            sum += shape.second->getVal(*obs);
+        }
+        double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (sum != sum) m_log.warning(("NaN density in " + prefix + shape.first).c_str());
+        m_components.push_back({prefix + shape.first, {time, data.numEntries()}});
+    }
+    return;
+}
+
+
+void FitTimer::Write(std::string filename){
+    m_log.info("Writing the fit timing to " + filename);
+    std::ofstream outfile(filename);
+
+    outfile << "* Fit timing. Category times are only measured when the NLL is evaluated per category (nll_workers);\n";
+    outfile << "* component costs are one pass of each shape over the data after the fit, not time spent in the fit\n\n";
+
+    // Stages
+    outfile << "* Stages: wall and CPU time (s), minimiser calls, NLL evaluations of the stage and of the stages nested in it\n";
+    outfile << "* cost_per_eval: wall time outside the nested stages over the stage's own NLL evaluations\n";
+    for (auto s: m_stages){
+        std::string key = "stage_" + s.name;
+        outfile << key << "_wall " << s.wall << std::endl;
+        outfile << key << "_cpu " << s.cpu << std::endl;
+        outfile << key << "_migrad " << s.migrad << std::endl;
+        outfile << key << "_hesse " << s.hesse << std::endl;
+        outfile << key << "_minos " << s.minos << std::endl;
+        if (s.nll_evals > 0){
+            outfile << key << "_nll_evals " << s.nll_evals << std::endl;
+            outfile << key << "_cost_per_eval " << (s.wall - s.nested_wall) / s.nll_evals << std::endl;
+        }
+        if (s.nested_evals > 0) outfile << key << "_nested_nll_evals " << s.nested_evals << std::endl;
+    }
+
+    // Categories
+    if (!m_categories.empty()){
+        outfile << "\n* Categories: total NLL time (s) and time per evaluation\n";
+        outfile << "category_nll_evals " << m_category_evals << std::endl;
+        for (auto c: m_categories){
+            outfile << "category_" << c.first << "_time " << c.second << std::endl;
+            if (m_category_evals > 0) outfile << "category_" << c.first << "_cost_per_eval " << c.second / m_category_evals << std::endl;
+        }
+    }
+
+    // Components
+    if (!m_components.empty()){
+        outfile << "\n* Components: time of one pass over the data (s) and time per entry\n";
+        for (auto c: m_components){
+            outfile << "component_" << c.first << "_time " << c.second.first << std::endl;
+            if (c.second.second > 0) outfile << "component_" << c.first << "_cost_per_entry " << c.second.first / c.second.second << std::endl;
+        }
+    }
+
+    outfile.close();
+    return;
+}
@@ -1,29 +1,125 @@
 #include "Fitter.hpp"
+#include "TextFileUtils.hpp"
+
+namespace {
+
+    /** Settings read by the fit, interned once */
+    const Settings::Key key_warm_start_file = Settings::Intern("warm_start_file");
+    const Settings::Key key_binned_fit_compare = Settings::Intern("binned_fit_compare");
+    const Settings::Key key_fit_timing = Settings::Intern("fit_timing");
+
+}
 
 void Fitter::RunFit(){
 
-    // Initial fit
-    if (m_debug) m_log.info("Running the first fit ...");
-    auto r = m_fm->pdf->fitTo(*m_dt->data, RooFit::Save(1), RooFit::Extended(1));
-    r->Print("v");
+    // Fit stages, starting from a previous fit if there is one
+    FitPipeline pipeline(m_settings, m_vars, DefaultStages(), m_debug);
+    if (m_settings.key_exists(key_warm_start_file)) WarmStart(pipeline);
+    std::unique_ptr<RooArgSet> pdf_pars(m_fm->pdf->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag)));
+    m_initial_pars.reset((RooArgSet*) pdf_pars->snapshot());
+    m_result = RunStages(pipeline, *m_fm->FitPdf(), *m_dt->FitData(), "");
+
+    // Bias of the binned fit
+    if (m_dt->FitData() != m_dt->data.get() && m_settings.getB(key_binned_fit_compare)) CompareUnbinned();
 
-    // Second fit
-    if (CheckYields() | CheckBkgSlopes()){
-        if (m_debug) m_log.info("Running the second fit ...");
-        m_result = m_fm->pdf->fitTo(*m_dt->data, RooFit::Save(1), RooFit::Extended(1));
-        m_result->Print("v");
-    }
-    else m_result = r;
     m_log.success("Fit complete!");
     return;
 }
 
 
-bool Fitter::CheckYields(){    
+RooFitResult* Fitter::RunStages(FitPipeline& pipeline, RooAbsPdf& pdf, RooAbsData& data, std::string label){
+    RooFitResult* result = nullptr;
+    for (auto stage: pipeline.Stages()){
+        if (pipeline.Skip(stage)){
+            if (m_debug) m_log.info("Skipping the " + label + stage.name + " fit");
+            continue;
+        }
+        if (m_debug) m_log.info("Running the " + label + stage.name + " fit ...");
+        pipeline.Prepare(stage);
+        long nll_evals = 0;
+        m_timer.Start(label + stage.name, 0);
+        result = pipeline.Fit(pdf, data, stage, true, nll_evals);
+        m_timer.Stop(result, nll_evals);
+        result->Print("v");
+        pipeline.Finish();
+        RunChecks(stage, pipeline);
+    }
+    if (!result){
+        m_log.error("No fit stage was run");
+        exit(1);
+    }
+    return result;
+}
+
+
+std::vector<FitPipeline::Stage> Fitter::DefaultStages(){
+    FitPipeline::Stage initial;
+    initial.name = "initial";
+    initial.checks = {"yields", "slopes"};
+    FitPipeline::Stage second;
+    second.name = "second";
+    second.skip_if = "unchanged";
+    return {initial, second};
+}
+
+
+void Fitter::RunChecks(const FitPipeline::Stage& stage, FitPipeline& pipeline){
+    for (auto check: stage.checks){
+        if (check == "yields") CheckYields();
+        else if (check == "slopes") CheckBkgSlopes();
+    }
+    pipeline.Update();
+    return;
+}
+
+
+void Fitter::CompareUnbinned(){
+    m_log.info("Repeating the fit stages unbinned, from the same starting values, to compare with the binned fit");
+    std::unique_ptr<RooArgSet> pdf_pars(m_fm->pdf->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag)));
+    std::unique_ptr<RooArgSet> binned_pars((RooArgSet*) pdf_pars->snapshot());
+    FitResultUtils::RestoreParameters(*pdf_pars, *m_initial_pars);
+    FitPipeline pipeline(m_settings, m_vars, DefaultStages(), m_debug);
+    std::unique_ptr<RooFitResult> unbinned(RunStages(pipeline, *m_fm->pdf, *m_dt->data, "unbinned_"));
+
+    std::string outfile_name = OutputPrefix() + "binned_comparison.txt";
+    m_log.info("Writing the comparison to " + outfile_name);
+    FitResultUtils::WriteComparison(m_result, unbinned.get(), m_dt->IntegrateBins(), outfile_name);
+
+    // Back to the binned result
+    FitResultUtils::RestoreParameters(*pdf_pars, *binned_pars);
+    return;
+}
+
+
+std::string Fitter::OutputPrefix(){
+    return TextFileUtils::OutputPrefix(m_settings);
+}
+
+
+void Fitter::WarmStart(FitPipeline& pipeline){
+    std::string filename = m_settings.get(key_warm_start_file);
+    m_log.info("Initialising the parameters from " + filename);
+    auto snapshot = FitResultUtils::ReadSnapshot(filename);
+    std::unique_ptr<RooArgSet> pdf_pars(m_fm->pdf->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag)));
+    int n_set = FitResultUtils::ApplySnapshot(*pdf_pars, snapshot);
+    if (m_debug) m_log.debug(("Set " + std::to_string(n_set) + "/" + std::to_string(snapshot.size()) + " parameters from the snapshot").c_str());
+
+    // Covariance for the first minimisation
+    std::vector<std::string> names;
+    TMatrixDSym covariance;
+    if (FitResultUtils::ReadCovariance(filename, names, covariance)) pipeline.SeedCovariance(names, covariance);
+    else if (m_debug) m_log.debug("No usable covariance matrix in " + filename + ", only the step sizes are set");
+    return;
+}
+
+
+bool Fitter::CheckYields(){
     if (m_debug) m_log.info("Checking for zero yields");
     bool second_fit = false;
     for (auto c: m_fm->components){
-        RooRealVar* yield = (RooRealVar*) c.second.yield;
+        RooRealVar* yield = dynamic_cast<RooRealVar*>(c.second.yield);
+        const ParameterRegistry::Entry* entry = m_vars->registry.Find(yield);
+        if (!entry || entry->role != ParameterRegistry::Yield || yield->isConstant()) continue;
         if (yield->getVal() < 1){
 
             // Fix yield
@@ -32,15 +128,11 @@ bool Fitter::CheckYields(){
             yield->setVal(0);
             yield->setConstant(true);
 
-            // Fix associated parameters
-            RooArgSet* component_pars = c.second.shape->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag));
-            TIterator* iter(component_pars->createIterator());
-            for (TObject *a = iter->Next(); a != 0; a = iter->Next()) {
-                RooRealVar *p = (RooRealVar*) a;  
-                TString par_name = p->GetName();
-                if (par_name.Contains("smear")) continue;
-                m_log.warning("Fixing " + par_name);
-                p->setConstant(true);            
+            // Fix the shape parameters of the component
+            for (auto p: m_vars->registry.Get(entry->category, entry->component)){
+                if (m_vars->registry.Find(p)->role != ParameterRegistry::Shape) continue;
+                m_log.warning(TString("Fixing ") + p->GetName());
+                p->setConstant(true);
             }
         }
     }
@@ -52,19 +144,14 @@ bool Fitter::CheckYields(){
 bool Fitter::CheckBkgSlopes(){
     if (m_debug) m_log.info("Checking if bkg slopes are at limits");
     bool second_fit = false;
-    RooArgSet* pdf_pars = m_fm->pdf->getParameters(RooArgSet(*m_vars->m_kpi, *m_vars->m_tag));
-    TIterator* iter(pdf_pars->createIterator());
-    for (TObject *a = iter->Next(); a != 0; a = iter->Next()) {
-        RooRealVar *p = (RooRealVar*) a;
-        TString name = p->GetName();
-        if (name.Contains("exponent")){
-            double maxRatio = p->getVal() / p->getMax() ;
-            double minRatio = p->getVal() / p->getMin() ;
-            if (maxRatio > 0.99 | minRatio > 0.99){
-                if (m_debug){ m_log.debug(name + " was found to be at the limit. Fixing it."); }
-                p->setConstant(true);
-                second_fit = true;
-            }
+    for (auto p: m_vars->registry.Slopes()){
+        if (p->isConstant()) continue;
+        double maxRatio = p->getVal() / p->getMax() ;
+        double minRatio = p->getVal() / p->getMin() ;
+        if (maxRatio > 0.99 | minRatio > 0.99){
+            if (m_debug){ m_log.debug(TString(p->GetName()) + " was found to be at the limit. Fixing it."); }
+            p->setConstant(true);
+            second_fit = true;
         }
     }
     return second_fit;
@@ -74,9 +161,7 @@ bool Fitter::CheckBkgSlopes(){
 void Fitter::SaveOutput(){
 
     // Open the outfile
-    std::string prename = "";
-    if (m_settings.key_exists("prename")) prename = m_settings.get("prename");
-    std::string outfile_name = "output/" + m_settings.get("tag") + "/" + m_settings.get("prod") + "/" + prename + "fit_results.txt";
+    std::string outfile_name = OutputPrefix() + "fit_results.txt";
     m_log.info("Writing output to " + outfile_name);
     std::ofstream m_outfile;
     m_outfile.open(outfile_name);
@@ -112,5 +197,20 @@ void Fitter::SaveOutput(){
 
     m_outfile.close();
 
+    // Binary snapshot for warm starts
+    FitResultUtils::WriteBinaryResults(m_result, outfile_name.substr(0, outfile_name.size() - 4) + ".root");
+
+    // Where the fit time went
+    if (m_settings.getB(key_fit_timing)) WriteTiming(OutputPrefix() + "fit_timing.txt");
+
+    return;
+}
+
+
+void Fitter::WriteTiming(std::string filename){
+    std::map<std::string, RooAbsPdf*> shapes;
+    for (auto c: m_fm->components) shapes[c.first] = c.second.shape;
+    m_timer.ProfileComponents("", shapes, *m_dt->FitData());
+    m_timer.Write(filename);
     return;
 }
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include "MCMatrices.hpp"
+#include "ThreadPool.hpp"
+#include "Selection.hpp"
+#include "Log.hpp"
+
+#include "TChain.h"
+#include "TFile.h"
+#include "TH2F.h"
+#include "TROOT.h"
+#include "TTreeFormula.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace MCMatrices {
+
+    namespace {
+
+        /**
+         * Column of a dataset variable
+         * @param mc dataset
+         * @param var variable to find in the dataset
+        */
+        RooRealVar* FindColumn(RooDataSet& mc, RooRealVar* var){
+            RooRealVar* column = (RooRealVar*) mc.get()->find(var->GetName());
+            if (!column){
+                Log("MCMatrices").error(std::string("No ") + var->GetName() + " in " + mc.GetName());
+                exit(1);
+            }
+            return column;
+        }
+
+        /**
+         * Binomial error of a weighted fraction
+         * @param p fraction
+         * @param pass_w2 sum of squared weights passing
+         * @param total sum of weights
+         * @param total_w2 sum of squared weights
+        */
+        double BinomialError(double p, double pass_w2, double total, double total_w2){
+            double variance = ((1 - 2*p) * pass_w2 + p*p * total_w2) / (total*total);
+            return std::sqrt(std::max(variance, 0.));
+        }
+
+        /** Number of chunks the entries are split into */
+        int NChunks(long n, int nthreads){ return std::max(1l, std::min(n, 4l*nthreads)); }
+
+        /**
+         * Split [0, n) into NChunks chunks and run a task on each, sharing them between threads
+         * @param n number of entries
+         * @param nthreads number of threads
+         * @param task function of the chunk index and its first and last entry
+        */
+        void RunChunks(long n, int nthreads, std::function<void(int, long, long)> task){
+            int nchunks = NChunks(n, nthreads);
+            std::vector<std::function<void()>> tasks;
+            for (int c=0; c<nchunks; c++){
+                long first = n * c / nchunks;
+                long last = n * (c+1) / nchunks;
+                tasks.push_back([&task, c, first, last]{ task(c, first, last); });
+            }
+            if (nthreads <= 1){
+                for (auto& t: tasks) t();
+            }
+            else{
+                ThreadPool pool(std::min(nthreads, nchunks));
+                pool.Run(tasks);
+            }
+            return;
+        }
+
+        /** Value of a formula for the current entry */
+        double Evaluate(TTreeFormula& formula){
+            formula.GetNdata();
+            return formula.EvalInstance();
+        }
+
+        /**
+         * Count the candidates of a range of entries of the truth tree
+         * @param files signal MC ROOT files
+         * @param tag name of the tag
+         * @param first first entry
+         * @param last entry after the last one
+         * @param counts counts to fill, keyed by matrix name
+        */
+        void CountEntries(const std::vector<std::string>& files, std::string tag, long first, long last, std::map<std::string, UnfoldingCounts>& counts){
+
+            // Own chain and formulas, as neither can be shared between threads
+            TChain chain((tag + "_vs_KPi_truth_tree").c_str());
+            for (auto& file: files) chain.Add(file.c_str());
+            std::vector<std::unique_ptr<TTreeFormula>> formulas;
+            auto formula = [&](TString expression){
+                formulas.push_back(std::make_unique<TTreeFormula>(Form("formula_%zu", formulas.size()), expression == "" ? "1" : expression, &chain));
+                return formulas.back().get();
+            };
+            std::vector<TTreeFormula*> prod_cuts;
+            for (auto prod: Definitions::PRODS) prod_cuts.push_back(formula(Selection::ProdCut(prod, tag)));
+            TTreeFormula* tag_cut = formula(Selection::TagCut(tag));
+            std::vector<TTreeFormula*> truth;
+            for (auto flag: {"DST_ToGamma", "DST_ToPi0", "DSTDST_ToGammaGamma", "DSTDST_ToPi0Gamma", "DSTDST_ToPi0Pi0"}) truth.push_back(formula(flag));
+            TTreeFormula* dp_bin = (tag == "KSPiPi") ? formula(tag + "_vs_KPi_bin") : nullptr;
+
+            // Counts of the tag and of the DP regions
+            UnfoldingCounts& tag_counts = counts[tag + "_vs_KPi.txt"];
+            std::vector<UnfoldingCounts*> bin_counts;
+            if (dp_bin){
+                for (int b=1; b<=EfficiencyUtils::nbins/2; b++) bin_counts.push_back(&counts[tag + "_vs_KPiFTbin" + std::to_string(b) + ".txt"]);
+            }
+
+            int tree_number = -1;
+            for (long i=first; i<last; i++){
+                if (chain.LoadTree(i) < 0) break;
+                if (chain.GetTreeNumber() != tree_number){
+                    tree_number = chain.GetTreeNumber();
+                    for (auto& f: formulas) f->UpdateFormulaLeaves();
+                }
+                int t = TrueProd(Evaluate(*truth[0]) > 0, Evaluate(*truth[1]) > 0, Evaluate(*truth[2]) > 0, Evaluate(*truth[3]) > 0, Evaluate(*truth[4]) > 0);
+                bool tag_pass = Evaluate(*tag_cut) != 0;
+                UnfoldingCounts* region = nullptr;
+                if (dp_bin){
+                    int bin = std::abs(std::lround(Evaluate(*dp_bin)));
+                    if (bin >= 1 && bin <= EfficiencyUtils::nbins/2) region = bin_counts[bin-1];
+                }
+                tag_counts.total[t] += 1;
+                if (region) region->total[t] += 1;
+                if (!tag_pass) continue;
+                for (int p=0; p<EfficiencyUtils::nprods; p++){
+                    if (Evaluate(*prod_cuts[p]) == 0) continue;
+                    tag_counts.selected[p][t] += 1;
+                    if (region) region->selected[p][t] += 1;
+                }
+            }
+            return;
+        }
+
+    }
+
+
+    MigrationCounts& MigrationCounts::operator+=(const MigrationCounts& other){
+        for (int k=0; k<EfficiencyUtils::nbins; k++){
+            for (int l=0; l<EfficiencyUtils::nbins; l++){
+                sumw[k][l] += other.sumw[k][l];
+                sumw2[k][l] += other.sumw2[k][l];
+            }
+        }
+        return *this;
+    }
+
+
+    UnfoldingCounts& UnfoldingCounts::operator+=(const UnfoldingCounts& other){
+        for (int t=0; t<EfficiencyUtils::nprods; t++){
+            total[t] += other.total[t];
+            for (int p=0; p<EfficiencyUtils::nprods; p++) selected[p][t] += other.selected[p][t];
+        }
+        return *this;
+    }
+
+
+    MigrationCounts CountMigration(RooDataSet& mc, Variables* vars, int nthreads){
+
+        // Read the dataset once; loading its rows isn't thread safe
+        RooRealVar* reco_bin = FindColumn(mc, vars->dalitz_bin);
+        RooRealVar* true_bin = FindColumn(mc, vars->true_dalitz_bin);
+        RooRealVar* kaon_charge = FindColumn(mc, vars->kaon_charge);
+        int nentries = mc.numEntries();
+        std::vector<int> reco_index(nentries), true_index(nentries);
+        std::vector<double> weights(nentries);
+        for (int i=0; i<nentries; i++){
+            mc.get(i);
+            reco_index[i] = BinIndex(std::lround(reco_bin->getVal()), kaon_charge->getVal());
+            true_index[i] = BinIndex(std::lround(true_bin->getVal()), kaon_charge->getVal());
+            weights[i] = mc.weight();
+        }
+
+        // Count in chunks, each with its own counts
+        std::vector<MigrationCounts> chunk_counts(NChunks(nentries, nthreads));
+        RunChunks(nentries, nthreads, [&](int c, long first, long last){
+            MigrationCounts& counts = chunk_counts[c];
+            for (long i=first; i<last; i++){
+                if (reco_index[i] < 0 || true_index[i] < 0) continue;
+                counts.sumw[reco_index[i]][true_index[i]] += weights[i];
+                counts.sumw2[reco_index[i]][true_index[i]] += weights[i]*weights[i];
+            }
+        });
+
+        // Merge
+        MigrationCounts total;
+        for (auto& counts: chunk_counts) total += counts;
+        return total;
+    }
+
+
+    MatrixWithErrors MigrationMatrix(const MigrationCounts& counts){
+        const int n = EfficiencyUtils::nbins;
+        MatrixWithErrors migration{TMatrixD(n, n), TMatrixD(n, n)};
+        for (int l=0; l<n; l++){
+
+            // Candidates generated in the true bin
+            double total = 0, total2 = 0;
+            for (int k=0; k<n; k++){
+                total += counts.sumw[k][l];
+                total2 += counts.sumw2[k][l];
+            }
+            if (total <= 0){
+                Log("MCMatrices").warning(("No MC candidates in true DP bin " + std::to_string(Definitions::DP_BINS[l])).c_str());
+                migration.matrix(l, l) = 1;
+                continue;
+            }
+
+            // Fraction reconstructed in each bin, with its binomial error
+            for (int k=0; k<n; k++){
+                double p = counts.sumw[k][l] / total;
+                migration.matrix(k, l) = p;
+                migration.errors(k, l) = BinomialError(p, counts.sumw2[k][l], total, total2);
+            }
+        }
+        return migration;
+    }
+
+
+    void WriteMigrationMatrix(std::string filename, const MatrixWithErrors& migration){
+        const int n = EfficiencyUtils::nbins;
+        TFile file(filename.c_str(), "RECREATE");
+        TH2F hist("migMatrix", ";true DP bin;reconstructed DP bin", n, 0, n, n, 0, n);
+        for (int i=0; i<n; i++){
+            hist.GetXaxis()->SetBinLabel(i+1, std::to_string(Definitions::DP_BINS[i]).c_str());
+            hist.GetYaxis()->SetBinLabel(i+1, std::to_string(Definitions::DP_BINS[i]).c_str());
+            for (int j=0; j<n; j++){
+                hist.SetBinContent(i+1, j+1, migration.matrix(j, i));
+                hist.SetBinError(i+1, j+1, migration.errors(j, i));
+            }
+        }
+        hist.Write();
+        file.Close();
+        return;
+    }
+
+
+
+    std::map<std::string, UnfoldingCounts> CountUnfolding(const std::vector<std::string>& files, std::string tag, int nthreads){
+
+        // Entries of the truth tree
+        long nentries;
+        {
+            TChain chain((tag + "_vs_KPi_truth_tree").c_str());
+            for (auto& file: files) chain.Add(file.c_str());
+            nentries = chain.GetEntries();
+        }
+        if (nthreads > 1) ROOT::EnableThreadSafety();
+
+        // Count in chunks, each reading its own entries
+        std::vector<std::map<std::string, UnfoldingCounts>> chunk_counts(NChunks(nentries, nthreads));
+        RunChunks(nentries, nthreads, [&](int c, long first, long last){
+            CountEntries(files, tag, first, last, chunk_counts[c]);
+        });
+
+        // Merge
+        std::map<std::string, UnfoldingCounts> total;
+        for (auto& counts: chunk_counts){
+            for (auto& entry: counts) total[entry.first] += entry.second;
+        }
+        return total;
+    }
+
+
+    MatrixWithErrors UnfoldingMatrix(const UnfoldingCounts& counts){
+        const int n = EfficiencyUtils::nprods;
+        MatrixWithErrors unfolding{TMatrixD(n, n), TMatrixD(n, n)};
+        for (int t=0; t<n; t++){
+            if (counts.total[t] <= 0){
+                Log("MCMatrices").warning(("No MC candidates of " + Definitions::PRODS[t]).c_str());
+                continue;
+            }
+            for (int p=0; p<n; p++){
+                double f = counts.selected[p][t] / counts.total[t];
+                unfolding.matrix(p, t) = f;
+                unfolding.errors(p, t) = BinomialError(f, counts.selected[p][t], counts.total[t], counts.total[t]);
+            }
+        }
+        return unfolding;
+    }
+
+
+    void WriteUnfoldingMatrix(std::string filename, const TMatrixD& unfolding){
+        std::ofstream out(filename);
+        out.precision(10);
+        for (int i=0; i<unfolding.GetNrows(); i++){
+            for (int j=0; j<unfolding.GetNcols(); j++){
+                if (j > 0) out << " ";
+                out << 100*unfolding(i, j);
+            }
+            out << "\n";
+        }
+        out.close();
+        return;
+    }
+
+}
@@ -0,0 +1,42 @@
+#include "ParameterRegistry.hpp"
+
+void ParameterRegistry::Register(RooRealVar* var, Role role, std::string category, std::string component, bool slope){
+    if (!var || m_index.count(var) > 0) return;
+    m_index[var] = m_entries.size();
+    m_entries.push_back({var, role, category, component, slope});
+    m_by_role[role].push_back(var);
+    m_by_component[category + "/" + component].push_back(var);
+    if (slope) m_slopes.push_back(var);
+    return;
+}
+
+
+const ParameterRegistry::Entry* ParameterRegistry::Find(const RooAbsArg* var) const {
+    auto it = m_index.find(var);
+    if (it == m_index.end()) return nullptr;
+    return &m_entries[it->second];
+}
+
+
+const std::vector<RooRealVar*>& ParameterRegistry::Get(std::string category, std::string component) const {
+    static const std::vector<RooRealVar*> empty;
+    auto it = m_by_component.find(category + "/" + component);
+    if (it == m_by_component.end()) return empty;
+    return it->second;
+}
+
+
+void ParameterRegistry::SetConstant(Role role, bool constant){
+    for (auto var: m_by_role[role]) var->setConstant(constant);
+    return;
+}
+
+
+ParameterRegistry::Role ParameterRegistry::RoleFromString(std::string name){
+    if (name == "yield") return Yield;
+    if (name == "shape") return Shape;
+    if (name == "shared") return Shared;
+    if (name == "physics") return Physics;
+    if (name == "nuisance") return Nuisance;
+    return NRoles;
+}
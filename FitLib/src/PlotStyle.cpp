@@ -0,0 +1,118 @@
+#include "PlotStyle.hpp"
+
+#include "TROOT.h"
+#include "TStyle.h"
+
+#include <mutex>
+
+namespace PlotStyle {
+
+    namespace {
+
+        /** Build the style, as in style.C */
+        void Build(){
+
+            // Font, line thickness and text size
+            const Style_t lhcbFont = 42;
+            const Width_t lhcbWidth = 2;
+            const Float_t lhcbTSize = 0.06;
+
+            // Plain black on white colours
+            gROOT->SetStyle("Plain");
+            TStyle* lhcbStyle = new TStyle("lhcbStyle", "LHCb plots style");
+            lhcbStyle->SetFillColor(1);
+            lhcbStyle->SetFillStyle(1001);
+            lhcbStyle->SetFrameFillColor(0);
+            lhcbStyle->SetFrameBorderMode(0);
+            lhcbStyle->SetPadBorderMode(0);
+            lhcbStyle->SetPadColor(0);
+            lhcbStyle->SetCanvasBorderMode(0);
+            lhcbStyle->SetCanvasColor(0);
+            lhcbStyle->SetStatColor(0);
+            lhcbStyle->SetLegendBorderSize(0);
+            lhcbStyle->SetLegendFont(42);
+            lhcbStyle->SetLegendFillColor(0);
+            lhcbStyle->SetLegendTextSize(0.04);
+
+            // Paper and margin sizes
+            lhcbStyle->SetPaperSize(20, 26);
+            lhcbStyle->SetPadTopMargin(0.05);
+            lhcbStyle->SetPadRightMargin(0.03);
+            lhcbStyle->SetPadBottomMargin(0.16);
+            lhcbStyle->SetPadLeftMargin(0.18);
+
+            // Large fonts
+            lhcbStyle->SetTextFont(lhcbFont);
+            lhcbStyle->SetTextSize(lhcbTSize);
+            lhcbStyle->SetTitleFont(lhcbFont);
+            for (auto axis: {"x", "y", "z"}){
+                lhcbStyle->SetLabelFont(lhcbFont, axis);
+                lhcbStyle->SetLabelSize(0.85*lhcbTSize, axis);
+                lhcbStyle->SetTitleFont(lhcbFont, axis);
+                lhcbStyle->SetTitleSize(lhcbTSize, axis);
+            }
+
+            // Medium bold lines and thick markers
+            lhcbStyle->SetLineWidth(lhcbWidth);
+            lhcbStyle->SetFrameLineWidth(lhcbWidth);
+            lhcbStyle->SetHistLineWidth(lhcbWidth);
+            lhcbStyle->SetFuncWidth(lhcbWidth);
+            lhcbStyle->SetGridWidth(lhcbWidth);
+            lhcbStyle->SetLineStyleString(2, "[12 12]");
+            lhcbStyle->SetMarkerStyle(20);
+            lhcbStyle->SetMarkerSize(0.07);
+
+            // Label offsets
+            lhcbStyle->SetLabelOffset(0.010, "X");
+            lhcbStyle->SetLabelOffset(0.014, "Y");
+            lhcbStyle->SetLabelOffset(0.010, "Z");
+
+            // Histogram decorations
+            lhcbStyle->SetOptStat("emr");
+            lhcbStyle->SetStatFormat("6.3g");
+            lhcbStyle->SetOptTitle(0);
+            lhcbStyle->SetOptFit(0);
+
+            // Titles
+            lhcbStyle->SetTitleOffset(0.95, "X");
+            lhcbStyle->SetTitleOffset(1.5, "Y");
+            lhcbStyle->SetTitleOffset(0.05, "Z");
+            lhcbStyle->SetTitleFillColor(0);
+            lhcbStyle->SetTitleStyle(0);
+            lhcbStyle->SetTitleBorderSize(0);
+            lhcbStyle->SetTitleFont(lhcbFont, "title");
+            lhcbStyle->SetTitleX(0.0);
+            lhcbStyle->SetTitleY(1.0);
+            lhcbStyle->SetTitleW(1.0);
+            lhcbStyle->SetTitleH(0.05);
+
+            // Statistics box
+            lhcbStyle->SetStatBorderSize(0);
+            lhcbStyle->SetStatFont(lhcbFont);
+            lhcbStyle->SetStatFontSize(0.05);
+            lhcbStyle->SetStatX(0.9);
+            lhcbStyle->SetStatY(0.9);
+            lhcbStyle->SetStatW(0.25);
+            lhcbStyle->SetStatH(0.15);
+            lhcbStyle->SetTitleXOffset(0.86);
+            lhcbStyle->SetTitleYOffset(1.4);
+
+            // Only 5 divisions in x to avoid label overlaps
+            lhcbStyle->SetNdivisions(505, "x");
+            lhcbStyle->SetNdivisions(510, "y");
+
+            gROOT->SetStyle("lhcbStyle");
+            gROOT->ForceStyle();
+            return;
+        }
+
+    }
+
+
+    void Apply(){
+        static std::once_flag built;
+        std::call_once(built, Build);
+        return;
+    }
+
+}
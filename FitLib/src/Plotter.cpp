@@ -1,4 +1,5 @@
 #include "Plotter.hpp"
+#include "ProcessPool.hpp"
 
 #include "TFile.h"
 #include "TLine.h"
@@ -8,19 +9,33 @@
 
 #include "RooHist.h"
 
+#include <algorithm>
+
 using namespace RooFit;
 
+namespace {
+
+    /** Settings read for every plot of every category, interned once */
+    const Settings::Key key_prename = Settings::Intern("prename");
+    const Settings::Key key_tag = Settings::Intern("tag");
+    const Settings::Key key_prod = Settings::Intern("prod");
+    const Settings::Key key_nbins = Settings::Intern("nbins");
+    const Settings::Key key_grid_oversample = Settings::Intern("grid_oversample");
+    const Settings::Key key_grid_workers = Settings::Intern("grid_workers");
+
+}
+
 void Plotter::ScatterPlot(RooDataSet d, bool toy){
 
     // Create output filename
     TString prename = "";
-    if (m_settings.key_exists("prename")) prename = m_settings.getT("prename");
-    TString output = "output/" + m_settings.getT("tag") + "/" + m_settings.getT("prod") + "/" + prename + "scatter";
+    if (m_settings.key_exists(key_prename)) prename = m_settings.getT(key_prename);
+    TString output = "output/" + m_settings.getT(key_tag) + "/" + m_settings.getT(key_prod) + "/" + prename + "scatter";
     if (toy) output += "_toy";
 
     // Set bins    
     int nbins = 40;
-    if (m_settings.key_exists("nbins")){ nbins = m_settings.getI("nbins"); }
+    if (m_settings.key_exists(key_nbins)){ nbins = m_settings.getI(key_nbins); }
 
     // Styling
     TH1* hist = d.createHistogram("hist", *m_vars->m_kpi, RooFit::Binning(nbins), RooFit::YVar(*m_vars->m_tag, RooFit::Binning(nbins))) ;
@@ -33,7 +48,7 @@ void Plotter::ScatterPlot(RooDataSet d, bool toy){
         hist->SetMarkerSize(0.3);
     }
 
-    hist->GetYaxis()->SetTitle("m(" + m_particle_labels[m_settings.getT("tag")] + ") [GeV/c^{2}]");
+    hist->GetYaxis()->SetTitle("m(" + m_particle_labels[m_settings.getT(key_tag)] + ") [GeV/c^{2}]");
     hist->GetXaxis()->SetTitle("m(K^{-}#pi^{+}) [GeV/c^{2}]");
 
     // Plot
@@ -53,6 +68,49 @@ void Plotter::ScatterPlot(RooDataSet d, bool toy){
 
 }
 
+void Plotter::PlotResiduals(std::string cat_name){
+
+    // Create output filename
+    TString prename = "";
+    if (m_settings.key_exists(key_prename)) prename = m_settings.getT(key_prename);
+    TString output = "output/" + m_settings.getT(key_tag) + "/" + m_settings.getT(key_prod) + "/" + prename + "fit_residuals";
+
+    // Set bins
+    int nbins = 40;
+    if (m_settings.key_exists(key_nbins)){ nbins = m_settings.getI(key_nbins); }
+
+    // Maps
+    ProjectionGrid::Maps maps = Grid(cat_name, nbins)->ResidualMaps(*CategoryData(cat_name));
+    TString tag_title = "m(" + m_particle_labels[m_settings.getT(key_tag)] + ") (GeV/c^{2})";
+    for (TH2D* h: {maps.residuals.get(), maps.pulls.get()}){
+        h->GetXaxis()->SetTitle("m(K^{-}#pi^{+}) (GeV/c^{2})");
+        h->GetYaxis()->SetTitle(tag_title);
+    }
+    maps.pulls->SetMinimum(-5);
+    maps.pulls->SetMaximum(5);
+
+    // Plot
+    TCanvas canvas("canvas", "", 10, 44, 1200, 500);
+    canvas.Divide(2, 1);
+    canvas.cd(1);
+    gPad->SetRightMargin(0.15);
+    maps.residuals->Draw("COLZ");
+    canvas.cd(2);
+    gPad->SetRightMargin(0.15);
+    maps.pulls->Draw("COLZ");
+    canvas.Print(output + ".pdf");
+
+    // Save as root file
+    TFile root_file(output + ".root", "RECREATE");
+    maps.residuals->Write("residuals");
+    maps.pulls->Write("pulls");
+    root_file.Close();
+
+    return;
+
+}
+
+
 RooPlot* Plotter::PlotPulls(RooPlot* f, RooRealVar* var){
 
   RooHist* pulls = f->pullHist();
@@ -80,67 +138,110 @@ RooPlot* Plotter::PlotPulls(RooPlot* f, RooRealVar* var){
 }
 
 
+RooDataSet* Plotter::CategoryData(std::string cat_name){
+    if (cat_name == "") return m_dt->data.get();
+    auto& d = m_category_data[cat_name];
+    if (!d){
+        d.reset((RooDataSet*) m_dt->data->reduce(("(kspipi_catz==kspipi_catz::" + cat_name + ")").c_str()));
+        if (m_debug) d->Print("v");
+    }
+    return d.get();
+}
+
+
+ProjectionGrid* Plotter::Grid(std::string cat_name, int nbins){
+    auto& grid = m_grids[{cat_name, nbins}];
+    if (!grid){
+        int oversample = 4;
+        if (m_settings.key_exists(key_grid_oversample)) oversample = m_settings.getI(key_grid_oversample);
+        int nworkers = 1;
+        if (m_settings.key_exists(key_grid_workers)) nworkers = m_settings.getI(key_grid_workers);
+        grid = std::make_unique<ProjectionGrid>(m_vars->m_kpi, m_vars->m_tag, nbins, oversample);
+        grid->Fill(m_fm, nworkers);
+    }
+    return grid.get();
+}
+
+
+const RooCurve* Plotter::GetCurve(RooRealVar* var, int nbins, std::string cat_name, std::vector<std::string> components){
+
+    // Cached curve
+    std::string key = std::string(var->GetName()) + "|" + cat_name + "|" + std::to_string(nbins) + "|";
+    for (auto c: components) key += c + "+";
+    auto& curve = m_curves[key];
+    if (curve) return curve.get();
+
+    // Sum on the grid of the model
+    TString var_name = var->GetName();
+    if (UseGrid() && (var_name == m_vars->m_kpi->GetName() || var_name == m_vars->m_tag->GetName())){
+        curve = Grid(cat_name, nbins)->Curve(var, key, components);
+        return curve.get();
+    }
+
+    // Sum of several components, from the single-component curves
+    if (components.size() > 1){
+        const RooCurve* first = GetCurve(var, nbins, cat_name, {components[0]});
+        const RooCurve* rest = GetCurve(var, nbins, cat_name, std::vector<std::string>(components.begin() + 1, components.end()));
+        curve = std::make_unique<RooCurve>(key.c_str(), "", *first, *rest);
+        return curve.get();
+    }
+
+    // Project, normalised to the data as on the frames
+    if (m_debug) m_log.debug(("Projecting " + key).c_str());
+    std::unique_ptr<RooPlot> scratch(var->frame());
+    CategoryData(cat_name)->plotOn(scratch.get(), RooFit::Binning(nbins));
+    if (components.empty()) m_fm->pdf->plotOn(scratch.get(), RooFit::Name("curve"));
+    else m_fm->pdf->plotOn(scratch.get(), RooFit::Name("curve"), RooFit::Components(*m_fm->components[components[0]].shape));
+    curve.reset((RooCurve*) scratch->getCurve("curve")->Clone(key.c_str()));
+    return curve.get();
+}
+
+
+void Plotter::AddCurve(RooPlot* frame, const RooCurve* curve, TString name, Color_t colour, Style_t style, Width_t width, bool filled){
+    RooCurve* copy = (RooCurve*) curve->Clone(name);
+    copy->SetLineColor(colour);
+    copy->SetLineStyle(style);
+    copy->SetLineWidth(width);
+    if (filled){
+        copy->SetFillColor(colour);
+        copy->SetFillStyle(1001);
+    }
+    frame->addPlotable(copy, filled ? "FL" : "L");
+    return;
+}
+
+
 void Plotter::PlotProjection(RooPlot* frame, bool filled, int nbins, std::string cat_name){
 
     // Plot data and PDF
-    RooDataSet* d;
-    if (cat_name != "") d = (RooDataSet*) m_dt->data->reduce(("(kspipi_catz==kspipi_catz::" + cat_name + ")").c_str());
-    else d = m_dt->data.get();
-    d->Print("v");
-    d->plotOn(frame, RooFit::LineColor(kBlack), RooFit::Name("Data"), RooFit::Binning(nbins));    
-    m_fm->pdf->plotOn(frame, RooFit::LineColor(kRed), RooFit::Name("Fit"), RooFit::LineWidth(1.));
-
-    // Bkgs
-    int i = 0;
+    RooRealVar* var = (RooRealVar*) frame->getPlotVar();
+    RooDataSet* d = CategoryData(cat_name);
+    const RooCurve* fit = GetCurve(var, nbins, cat_name);
+    d->plotOn(frame, RooFit::LineColor(kBlack), RooFit::Name("Data"), RooFit::Binning(nbins));
+    AddCurve(frame, fit, "Fit", kRed, kSolid, 1);
+
+    // Bkgs, in the order of the components
+    std::vector<std::string> bkgs;
     for (auto c: m_fm->components){
-        if (c.first.find("signal") != std::string::npos) continue;
-        TString component_name = c.second.name.c_str();
+        if (c.first.find("signal") == std::string::npos) bkgs.push_back(c.first);
+    }
+    for (unsigned int i=0; i<bkgs.size(); i++){
+        TString component_name = m_fm->components[bkgs[i]].name.c_str();
+        TString plot_name = GetComponentName(component_name);
         if (m_debug) m_log.debug("Plotting " + component_name);
-        if (filled){
-            RooArgSet already_plotted;
-            int j = 0;
-            for (auto sc: m_fm->components){             
-                if (sc.first.find("signal") != std::string::npos) continue;
-                if (j>=i) already_plotted.add( *sc.second.shape );             
-                j += 1;
-            }
-            m_fm->pdf->plotOn(frame,
-                          RooFit::LineColor(m_component_colours[GetComponentName(component_name)]),
-                          RooFit::Name(GetComponentName(component_name)),
-                          RooFit::Components(already_plotted),
-                          RooFit::LineStyle(kSolid),
-                          RooFit::FillStyle(1001),
-                          RooFit::FillColor(m_component_colours[GetComponentName(component_name)]),
-                          RooFit::DrawOption("FL"),
-                          RooFit::LineWidth(2)
-                          );
-        }
-        else  m_fm->pdf->plotOn(frame,
-                           RooFit::LineColor(m_component_colours[GetComponentName(component_name)]),
-                           RooFit::Name(GetComponentName(component_name)),
-                           RooFit::Components(*c.second.shape),
-                           RooFit::LineStyle(kDashed),
-                           RooFit::DrawOption("L"),
-                           RooFit::LineWidth(1)
-                           );
-        i += 1;
+
+        // Filled plots stack this and the later components
+        if (filled) AddCurve(frame, GetCurve(var, nbins, cat_name, std::vector<std::string>(bkgs.begin() + i, bkgs.end())), plot_name, m_component_colours[plot_name], kSolid, 2, true);
+        else AddCurve(frame, GetCurve(var, nbins, cat_name, {bkgs[i]}), plot_name, m_component_colours[plot_name], kDashed, 1);
     }
 
     // Plot signal
-    m_fm->pdf->plotOn(frame,
-                      LineColor(m_component_colours[GetComponentName("signal")]),
-                      Name(GetComponentName("signal")),
-                      Components(*m_fm->components["signal"].shape),
-                      LineStyle(kDashed),
-                      DrawOption("L"),
-                      LineWidth(1)
-                      );
+    AddCurve(frame, GetCurve(var, nbins, cat_name, {"signal"}), GetComponentName("signal"), m_component_colours[GetComponentName("signal")], kDashed, 1);
 
     // Data/PDF again
-    d->plotOn(frame, RooFit::LineColor(kBlack), RooFit::Name("Data"), RooFit::Binning(nbins));    
-    m_fm->pdf->plotOn(frame, RooFit::LineColor(kRed), RooFit::Name("Fit"), RooFit::LineWidth(1));
-    d->plotOn(frame, RooFit::LineColor(kBlack), RooFit::Name("Data"), RooFit::Binning(nbins)); 
-    if (cat_name != "") delete d;
+    d->plotOn(frame, RooFit::LineColor(kBlack), RooFit::Name("Data"), RooFit::Binning(nbins));
+    AddCurve(frame, fit, "Fit", kRed, kSolid, 1);
+    d->plotOn(frame, RooFit::LineColor(kBlack), RooFit::Name("Data"), RooFit::Binning(nbins));
 
     return;
 
@@ -150,15 +251,15 @@ void Plotter::Plot(bool log, bool filled, bool pulls, std::string cat_name){
 
     // Create output filename
     TString prename = "";
-    if (m_settings.key_exists("prename")) prename = m_settings.getT("prename");
-    TString output = "output/" + m_settings.getT("tag") + "/" + m_settings.getT("prod") + "/" + prename + "fit";
+    if (m_settings.key_exists(key_prename)) prename = m_settings.getT(key_prename);
+    TString output = "output/" + m_settings.getT(key_tag) + "/" + m_settings.getT(key_prod) + "/" + prename + "fit";
     if (filled) output += "_filled";
     if (log) output += "_log";
     if (pulls) output += "_pulls";
 
     // Set bins    
     int nbins = 40;
-    if (m_settings.key_exists("nbins")){ nbins = m_settings.getI("nbins"); }
+    if (m_settings.key_exists(key_nbins)){ nbins = m_settings.getI(key_nbins); }
 
     // Setup plots
     TCanvas canvas("canvas", "", 10, 44, 1200, 800);
@@ -180,7 +281,7 @@ void Plotter::Plot(bool log, bool filled, bool pulls, std::string cat_name){
         kpi_plot_pad.SetLogy();
         tag_plot_pad.SetLogy();
     }
-    tag_frame->GetXaxis()->SetTitle("m(" + m_particle_labels[m_settings.getT("tag")] + ") (GeV/c^{2})");
+    tag_frame->GetXaxis()->SetTitle("m(" + m_particle_labels[m_settings.getT(key_tag)] + ") (GeV/c^{2})");
     kpi_frame->GetXaxis()->SetTitle("m(K^{-}#pi^{+}) (GeV/c^{2})");
     double kpi_bin_size = (m_vars->m_kpi->getMax() - m_vars->m_kpi->getMin()) / nbins;
     double tag_bin_size = (m_vars->m_tag->getMax() - m_vars->m_tag->getMin()) / nbins;
@@ -235,3 +336,41 @@ void Plotter::Plot(bool log, bool filled, bool pulls, std::string cat_name){
     return;
 
 }
+
+
+void Plotter::PlotCategories(Settings settings, Variables* vars, Data* dt, std::map<std::string, FitModel*> category_models, bool debug){
+    Log log("Plotter");
+    bool pulls = settings.getB("pulls");
+    std::vector<std::pair<std::string, FitModel*>> categories(category_models.begin(), category_models.end());
+
+    // Plots of one category, its files named after the category
+    auto plot = [&](int i){
+        Settings s = settings;
+        s.update_value("prename", categories[i].first);
+        Plotter pt(s, vars, dt, categories[i].second, debug);
+        pt.Plot(false, false, pulls, categories[i].first);
+        pt.Plot(false, true, pulls, categories[i].first);
+        if (pt.UseGrid()) pt.PlotResiduals(categories[i].first);
+        return;
+    };
+
+    int nworkers = 1;
+    if (settings.key_exists("plot_workers")) nworkers = settings.getI("plot_workers");
+    nworkers = std::max(1, std::min(nworkers, (int) categories.size()));
+    if (nworkers == 1){
+        for (unsigned int i=0; i<categories.size(); i++) plot(i);
+        return;
+    }
+
+    // Style the workers inherit
+    PlotStyle::Apply();
+    log.info(("Plotting " + std::to_string(categories.size()) + " categories with " + std::to_string(nworkers) + " workers").c_str());
+    auto results = ProcessPool::Map(categories.size(), nworkers, [&](int i){
+        plot(i);
+        return std::vector<double>{1};
+    });
+    for (unsigned int i=0; i<results.size(); i++){
+        if (results[i].empty()) log.warning(("Plotting failed for category " + categories[i].first).c_str());
+    }
+    return;
+}
@@ -0,0 +1,240 @@
+#include "ProcessPool.hpp"
+#include "Log.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace ProcessPool {
+
+    /** Running child process and the output it has sent so far */
+    struct Child {
+        pid_t pid;
+        int fd;
+        int task;
+        std::string buffer;
+    };
+
+
+    /** Write the whole buffer to a pipe */
+    bool WriteAll(int fd, const char* data, size_t size){
+        while (size > 0){
+            ssize_t n = write(fd, data, size);
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+
+    /** Read a whole buffer from a pipe */
+    bool ReadAll(int fd, char* data, size_t size){
+        while (size > 0){
+            ssize_t n = read(fd, data, size);
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+
+    /** Write a message: its number of values, then the values */
+    bool WriteMessage(int fd, const std::vector<double>& values){
+        uint64_t size = values.size();
+        return WriteAll(fd, (const char*) &size, sizeof(size)) && WriteAll(fd, (const char*) values.data(), size * sizeof(double));
+    }
+
+
+    /** Read a message written by WriteMessage */
+    bool ReadMessage(int fd, std::vector<double>& values){
+        uint64_t size;
+        if (!ReadAll(fd, (char*) &size, sizeof(size))) return false;
+        values.resize(size);
+        return ReadAll(fd, (char*) values.data(), size * sizeof(double));
+    }
+
+
+    std::vector<std::vector<double>> Map(int ntasks, int nworkers, std::function<std::vector<double>(int)> task){
+        std::vector<std::vector<double>> results(ntasks);
+        std::vector<Child> running;
+        if (nworkers < 1) nworkers = 1;
+        int next = 0;
+
+        while (next < ntasks || !running.empty()){
+
+            // Start children until all workers are busy. If no more can be
+            // started, the running children are still collected below.
+            while (next < ntasks && (int) running.size() < nworkers){
+                int fds[2];
+                if (pipe(fds) != 0){
+                    Log("ProcessPool").error("Can't open a pipe, not starting task " + std::to_string(next) + " or later");
+                    ntasks = next;
+                    break;
+                }
+                fflush(stdout);
+                fflush(stderr);
+                pid_t pid = fork();
+                if (pid < 0){
+                    Log("ProcessPool").error("Can't fork, not starting task " + std::to_string(next) + " or later");
+                    close(fds[0]);
+                    close(fds[1]);
+                    ntasks = next;
+                    break;
+                }
+                if (pid == 0){
+                    close(fds[0]);
+                    int status = 0;
+                    try{
+                        std::vector<double> values = task(next);
+                        if (!WriteAll(fds[1], (const char*) values.data(), values.size() * sizeof(double))) status = 1;
+                    }
+                    catch (...){ status = 1; }
+                    close(fds[1]);
+                    fflush(stdout);
+                    _exit(status);
+                }
+                close(fds[1]);
+                running.push_back({pid, fds[0], next, ""});
+                next += 1;
+            }
+
+            // Read whatever the children have sent
+            if (running.empty()) break;
+            std::vector<pollfd> pfds;
+            for (auto& c: running) pfds.push_back({c.fd, POLLIN, 0});
+            if (poll(pfds.data(), pfds.size(), -1) < 0) continue;
+            for (int i = running.size() - 1; i >= 0; i--){
+                if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+                char chunk[65536];
+                ssize_t n = read(running[i].fd, chunk, sizeof(chunk));
+                if (n > 0){ running[i].buffer.append(chunk, n); continue; }
+
+                // End of output: collect the child
+                close(running[i].fd);
+                int status = 0;
+                waitpid(running[i].pid, &status, 0);
+                const std::string& buffer = running[i].buffer;
+                if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && buffer.size() % sizeof(double) == 0){
+                    std::vector<double> values(buffer.size() / sizeof(double));
+                    if (!values.empty()) std::memcpy(values.data(), buffer.data(), buffer.size());
+                    results[running[i].task] = values;
+                }
+                else Log("ProcessPool").warning(("Task " + std::to_string(running[i].task) + " failed").c_str());
+                running.erase(running.begin() + i);
+            }
+        }
+        return results;
+    }
+
+
+
+    Workers::Workers(int nworkers, std::function<std::vector<double>(const std::vector<double>&)> serve){
+        m_owner = getpid();
+        for (int w=0; w<nworkers; w++){
+            int request[2], reply[2];
+            if (pipe(request) != 0 || pipe(reply) != 0){
+                Log("ProcessPool").error("Can't open the pipes of a worker");
+                exit(1);
+            }
+            fflush(stdout);
+            fflush(stderr);
+            pid_t pid = fork();
+            if (pid < 0){
+                Log("ProcessPool").error("Can't fork a worker");
+                exit(1);
+            }
+            if (pid == 0){
+
+                // Only this worker's ends of its own pipes, so the workers see the end of their requests
+                for (auto& other: m_workers){
+                    close(other.request_fd);
+                    close(other.reply_fd);
+                }
+                close(request[1]);
+                close(reply[0]);
+                int status = 0;
+                try{
+                    std::vector<double> values;
+                    while (ReadMessage(request[0], values)){
+                        if (!WriteMessage(reply[1], serve(values))){ status = 1; break; }
+                    }
+                }
+                catch (...){ status = 1; }
+                fflush(stdout);
+                _exit(status);
+            }
+            close(request[0]);
+            close(reply[1]);
+            m_workers.push_back({pid, request[1], reply[0], false});
+        }
+    }
+
+
+    Workers::~Workers(){
+        if (!Owner()) return;
+        for (auto& w: m_workers){
+            close(w.request_fd);
+            close(w.reply_fd);
+            waitpid(w.pid, nullptr, 0);
+        }
+    }
+
+
+    bool Workers::Owner() const { return getpid() == m_owner; }
+
+
+    void Workers::Send(int w, const std::vector<double>& request){
+        if (!WriteMessage(m_workers[w].request_fd, request)){
+            Log("ProcessPool").error("Can't send a request to worker " + std::to_string(w));
+            exit(1);
+        }
+        m_workers[w].busy = true;
+        return;
+    }
+
+
+    std::vector<double> Workers::Receive(int w){
+        std::vector<double> reply;
+        if (!ReadMessage(m_workers[w].reply_fd, reply)){
+            Log("ProcessPool").error("Worker " + std::to_string(w) + " failed");
+            exit(1);
+        }
+        m_workers[w].busy = false;
+        return reply;
+    }
+
+
+    int Workers::ReceiveAny(std::vector<double>& reply){
+        std::vector<pollfd> pfds;
+        std::vector<int> busy;
+        for (unsigned int w=0; w<m_workers.size(); w++){
+            if (!m_workers[w].busy) continue;
+            pfds.push_back({m_workers[w].reply_fd, POLLIN, 0});
+            busy.push_back(w);
+        }
+        if (busy.empty()){
+            Log("ProcessPool").error("No worker has a request in progress");
+            exit(1);
+        }
+        while (true){
+            if (poll(pfds.data(), pfds.size(), -1) < 0){
+                if (errno == EINTR) continue;
+                Log("ProcessPool").error("Can't wait for the workers");
+                exit(1);
+            }
+            for (unsigned int i=0; i<pfds.size(); i++){
+                if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+                reply = Receive(busy[i]);
+                return busy[i];
+            }
+        }
+    }
+
+}
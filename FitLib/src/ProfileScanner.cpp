@@ -0,0 +1,144 @@
+#include "ProfileScanner.hpp"
+#include "ProcessPool.hpp"
+#include "TextFileUtils.hpp"
+
+#include "RooMinimizer.h"
+#include "RooRealVar.h"
+#include "TFile.h"
+#include "TH2D.h"
+#include "TTree.h"
+
+#include <algorithm>
+#include <memory>
+
+std::vector<double> ProfileScanner::GetGrid(std::string axis, RooRealVar* var){
+    double low = var->getMin();
+    double high = var->getMax();
+    int npoints = 21;
+    if (m_settings.key_exists("scan_" + axis + "_min")) low = m_settings.getD("scan_" + axis + "_min");
+    if (m_settings.key_exists("scan_" + axis + "_max")) high = m_settings.getD("scan_" + axis + "_max");
+    if (m_settings.key_exists("scan_" + axis + "_points")) npoints = m_settings.getI("scan_" + axis + "_points");
+    std::vector<double> grid;
+    for (int i=0; i<npoints; i++){
+        if (npoints == 1) grid.push_back(low);
+        else grid.push_back(low + i * (high - low) / (npoints - 1));
+    }
+    return grid;
+}
+
+
+void ProfileScanner::Run(){
+
+    // Scanned parameters
+    std::string x_name = m_vars->rCosDelta->GetName();
+    std::string y_name = m_vars->rSinDelta->GetName();
+    if (m_settings.key_exists("scan_x_var")) x_name = m_settings.get("scan_x_var");
+    if (m_settings.key_exists("scan_y_var")) y_name = m_settings.get("scan_y_var");
+
+    // Build the NLL once, the workers inherit it
+    std::unique_ptr<RooAbsReal> nll(m_pdf->createNLL(*m_dt->FitData(), RooFit::Extended(true)));
+    std::unique_ptr<RooArgSet> pars(nll->getParameters(*m_dt->data));
+    RooRealVar* x = dynamic_cast<RooRealVar*>(pars->find(x_name.c_str()));
+    RooRealVar* y = dynamic_cast<RooRealVar*>(pars->find(y_name.c_str()));
+    if (!x || !y){
+        m_log.error("Can't find the scan parameters " + x_name + " and " + y_name);
+        return;
+    }
+    std::vector<RooRealVar*> nuisances;
+    for (auto arg: *pars){
+        RooRealVar* p = dynamic_cast<RooRealVar*>(arg);
+        if (!p || p->isConstant() || p == x || p == y) continue;
+        nuisances.push_back(p);
+    }
+    double global_nll = nll->getVal();
+    std::unique_ptr<RooArgSet> best((RooArgSet*) pars->snapshot());
+
+    // Grid
+    std::vector<double> x_grid = GetGrid("x", x);
+    std::vector<double> y_grid = GetGrid("y", y);
+    int nx = x_grid.size();
+    int ny = y_grid.size();
+    int nworkers = 1;
+    if (m_settings.key_exists("scan_workers")) nworkers = m_settings.getI("scan_workers");
+    nworkers = std::max(1, std::min(nworkers, ny));
+    m_log.info(("Scanning " + x_name + " vs " + y_name + " on a " + std::to_string(nx) + "x" + std::to_string(ny) + " grid with " + std::to_string(nworkers) + " workers").c_str());
+
+    // Each worker takes a band of rows and walks it in a serpentine path
+    const unsigned int nvalues = 4 + nuisances.size();
+    auto results = ProcessPool::Map(nworkers, nworkers, [&](int w){
+        std::vector<double> out;
+        pars->assignValueOnly(*best);
+        x->setConstant(true);
+        y->setConstant(true);
+        RooMinimizer minimizer(*nll);
+        minimizer.setPrintLevel(-1);
+        int row_begin = w * ny / nworkers;
+        int row_end = (w + 1) * ny / nworkers;
+        for (int j=row_begin; j<row_end; j++){
+            for (int k=0; k<nx; k++){
+                int i = ((j - row_begin) % 2 == 0) ? k : nx - 1 - k;
+                x->setVal(x_grid[i]);
+                y->setVal(y_grid[j]);
+                int status = minimizer.migrad();
+                out.insert(out.end(), {(double) i, (double) j, nll->getVal(), (double) status});
+                for (auto p: nuisances) out.push_back(p->getVal());
+            }
+        }
+        return out;
+    });
+
+    // Minimum of the grid and the global fit
+    double min_nll = global_nll;
+    for (auto& r: results){
+        for (unsigned int k=0; k + nvalues <= r.size(); k += nvalues) min_nll = std::min(min_nll, r[k+2]);
+    }
+
+    // Output
+    std::string outfile_name = TextFileUtils::OutputPrefix(m_settings) + "scan.root";
+    m_log.info("Writing scan to " + outfile_name);
+    TFile file(outfile_name.c_str(), "RECREATE");
+
+    double dx = (nx > 1) ? x_grid[1] - x_grid[0] : 1.;
+    double dy = (ny > 1) ? y_grid[1] - y_grid[0] : 1.;
+    TH2D* dnll_hist = new TH2D("dnll", "", nx, x_grid.front() - dx/2, x_grid.back() + dx/2, ny, y_grid.front() - dy/2, y_grid.back() + dy/2);
+    dnll_hist->GetXaxis()->SetTitle(x_name.c_str());
+    dnll_hist->GetYaxis()->SetTitle(y_name.c_str());
+
+    TTree* tree = new TTree("scan", "");
+    double x_val, y_val, nll_val, dnll_val;
+    int status;
+    std::vector<double> nuisance_vals(nuisances.size());
+    tree->Branch(x_name.c_str(), &x_val);
+    tree->Branch(y_name.c_str(), &y_val);
+    tree->Branch("nll", &nll_val);
+    tree->Branch("dnll", &dnll_val);
+    tree->Branch("status", &status);
+    for (unsigned int n=0; n<nuisances.size(); n++) tree->Branch(nuisances[n]->GetName(), &nuisance_vals[n]);
+
+    int nfailed = 0;
+    for (int w=0; w<nworkers; w++){
+        if (results[w].empty()) nfailed += 1;
+        for (unsigned int k=0; k + nvalues <= results[w].size(); k += nvalues){
+            const double* v = &results[w][k];
+            int i = v[0];
+            int j = v[1];
+            x_val = x_grid[i];
+            y_val = y_grid[j];
+            nll_val = v[2];
+            dnll_val = v[2] - min_nll;
+            status = v[3];
+            for (unsigned int n=0; n<nuisances.size(); n++) nuisance_vals[n] = v[4+n];
+            dnll_hist->SetBinContent(i+1, j+1, dnll_val);
+            tree->Fill();
+        }
+    }
+    if (nfailed > 0) m_log.warning((std::to_string(nfailed) + " scan workers failed").c_str());
+
+    dnll_hist->Write();
+    tree->Write();
+    file.Close();
+
+    // Back to the global minimum
+    pars->assignValueOnly(*best);
+    return;
+}
@@ -0,0 +1,186 @@
+#include "ProjectionGrid.hpp"
+#include "ProcessPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+ProjectionGrid::ProjectionGrid(RooRealVar* x, RooRealVar* y, int nbins, int oversample){
+    m_log = Log("ProjectionGrid");
+    m_x = x;
+    m_y = y;
+    m_nbins = nbins;
+    m_oversample = std::max(1, oversample);
+    m_n = m_nbins * m_oversample;
+}
+
+
+void ProjectionGrid::Fill(FitModel* fm, int nworkers){
+    const int n = m_n;
+    std::vector<std::string> names;
+    for (auto& c: fm->components) names.push_back(c.first);
+    nworkers = std::max(1, std::min(nworkers, n));
+    m_log.info(("Evaluating " + std::to_string(names.size()) + " components on a " + std::to_string(n) + "x" + std::to_string(n) + " grid").c_str());
+
+    // Densities of each component on a band of x rows, component-major,
+    // evaluated in one batch over a dataset of the cell centres of the band
+    auto evaluate = [&](int w){
+        std::vector<double> out;
+        int row_begin = w * n / nworkers;
+        int row_end = (w + 1) * n / nworkers;
+        RooDataSet centres("grid_centres", "", RooArgSet(*m_x, *m_y));
+        for (int i=row_begin; i<row_end; i++){
+            m_x->setVal(Centre(m_x, i));
+            for (int j=0; j<n; j++){
+                m_y->setVal(Centre(m_y, j));
+                centres.add(RooArgSet(*m_x, *m_y));
+            }
+        }
+        out.reserve((std::size_t) names.size() * centres.numEntries());
+        for (auto& name: names){
+            std::vector<double> values = fm->components[name].shape->getValues(centres);
+            out.insert(out.end(), values.begin(), values.end());
+        }
+        return out;
+    };
+
+    // Evaluate here or in forked workers, keeping the observables as they were
+    std::vector<std::vector<double>> bands;
+    if (nworkers == 1){
+        double x = m_x->getVal(), y = m_y->getVal();
+        bands.push_back(evaluate(0));
+        m_x->setVal(x);
+        m_y->setVal(y);
+    }
+    else bands = ProcessPool::Map(nworkers, nworkers, evaluate);
+
+    // Gather the bands into a grid per component
+    m_values.clear();
+    for (auto& name: names) m_values[name].resize((std::size_t) n * n);
+    for (int w=0; w<nworkers; w++){
+        int row_begin = w * n / nworkers;
+        int row_end = (w + 1) * n / nworkers;
+        std::size_t band_size = (std::size_t) (row_end - row_begin) * n;
+        if (bands[w].size() != names.size() * band_size){
+            m_log.error("Grid worker " + std::to_string(w) + " failed");
+            exit(1);
+        }
+        for (unsigned int c=0; c<names.size(); c++){
+            std::copy(bands[w].begin() + c * band_size, bands[w].begin() + (c + 1) * band_size, m_values[names[c]].begin() + (std::size_t) row_begin * n);
+        }
+    }
+
+    // Scale each component to its yield, so the sums carry no error from the cell size
+    for (auto& name: names){
+        std::vector<double>& values = m_values[name];
+        double total = 0;
+        for (double v: values) total += v;
+        double scale = (total > 0) ? fm->components[name].yield->getVal() / total : 0;
+        if (total <= 0) m_log.warning(("Component " + name + " vanishes on the grid").c_str());
+        for (double& v: values) v *= scale;
+    }
+    return;
+}
+
+
+std::vector<double> ProjectionGrid::Sum(const std::vector<std::string>& components) const {
+    std::vector<double> total((std::size_t) m_n * m_n, 0.);
+    for (auto& c: m_values){
+        if (!components.empty() && std::find(components.begin(), components.end(), c.first) == components.end()) continue;
+        const double* v = c.second.data();
+        double* t = total.data();
+        for (std::size_t k=0; k<total.size(); k++) t[k] += v[k];
+    }
+    return total;
+}
+
+
+std::vector<double> ProjectionGrid::Projection(RooRealVar* var, std::vector<std::string> components) const {
+    const int n = m_n;
+    std::vector<double> total = Sum(components);
+    std::vector<double> projection(n, 0.);
+    double* p = projection.data();
+
+    // Events in a bin of the data are those of oversample cells
+    std::string name = var->GetName();
+    if (name == m_x->GetName()){
+        for (int i=0; i<n; i++){
+            const double* row = total.data() + (std::size_t) i * n;
+            double sum = 0;
+            for (int j=0; j<n; j++) sum += row[j];
+            p[i] = m_oversample * sum;
+        }
+    }
+    else if (name == m_y->GetName()){
+        for (int i=0; i<n; i++){
+            const double* row = total.data() + (std::size_t) i * n;
+            for (int j=0; j<n; j++) p[j] += row[j];
+        }
+        for (int j=0; j<n; j++) p[j] *= m_oversample;
+    }
+    else{
+        m_log.error("No grid axis for " + name);
+        exit(1);
+    }
+    return projection;
+}
+
+
+std::unique_ptr<RooCurve> ProjectionGrid::Curve(RooRealVar* var, std::string name, std::vector<std::string> components) const {
+    std::vector<double> projection = Projection(var, components);
+
+    // Closed at zero at both ends, as RooFit draws its curves, so they can be filled
+    auto curve = std::make_unique<RooCurve>();
+    curve->SetName(name.c_str());
+    curve->addPoint(var->getMin(), 0);
+    curve->addPoint(var->getMin(), projection.front());
+    for (int i=0; i<m_n; i++) curve->addPoint(Centre(var, i), projection[i]);
+    curve->addPoint(var->getMax(), projection.back());
+    curve->addPoint(var->getMax(), 0);
+    return curve;
+}
+
+
+ProjectionGrid::Maps ProjectionGrid::ResidualMaps(RooDataSet& data, std::string prename) const {
+    const int n = m_n;
+    Maps maps;
+    auto make = [&](std::string name, std::string title){
+        auto h = std::make_unique<TH2D>((prename + name).c_str(), title.c_str(), m_nbins, m_x->getMin(), m_x->getMax(), m_nbins, m_y->getMin(), m_y->getMax());
+        h->SetDirectory(nullptr);
+        h->SetStats(0);
+        h->GetXaxis()->SetTitle(m_x->GetTitle());
+        h->GetYaxis()->SetTitle(m_y->GetTitle());
+        return h;
+    };
+    maps.residuals = make("residuals", "Data - Fit");
+    maps.pulls = make("pulls", "(Data - Fit) / #sqrt{Fit}");
+
+    // Data
+    RooRealVar* x = (RooRealVar*) data.get()->find(m_x->GetName());
+    RooRealVar* y = (RooRealVar*) data.get()->find(m_y->GetName());
+    if (!x || !y){
+        m_log.error(std::string("No ") + m_x->GetName() + " or " + m_y->GetName() + " in " + data.GetName());
+        exit(1);
+    }
+    for (int i=0; i<data.numEntries(); i++){
+        data.get(i);
+        maps.residuals->Fill(x->getVal(), y->getVal(), data.weight());
+    }
+
+    // Model, from the oversample x oversample cells of each bin
+    std::vector<double> total = Sum({});
+    std::vector<double> expected((std::size_t) m_nbins * m_nbins, 0.);
+    for (int i=0; i<n; i++){
+        const double* row = total.data() + (std::size_t) i * n;
+        double* bins = expected.data() + (std::size_t) (i / m_oversample) * m_nbins;
+        for (int j=0; j<n; j++) bins[j / m_oversample] += row[j];
+    }
+    for (int i=0; i<m_nbins; i++){
+        for (int j=0; j<m_nbins; j++){
+            double mu = expected[(std::size_t) i * m_nbins + j];
+            double residual = maps.residuals->GetBinContent(i+1, j+1) - mu;
+            maps.residuals->SetBinContent(i+1, j+1, residual);
+            maps.pulls->SetBinContent(i+1, j+1, (mu > 0) ? residual / std::sqrt(mu) : 0);
+        }
+    }
+    return maps;
+}
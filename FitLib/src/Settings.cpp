@@ -0,0 +1,130 @@
+#include "Settings.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace {
+
+    /** Process-wide table of interned keys */
+    struct KeyTable {
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, Settings::Key> ids;
+        std::deque<std::string> names;
+    };
+
+    KeyTable& Keys(){
+        static KeyTable table;
+        return table;
+    }
+
+}
+
+
+Settings::Key Settings::Lookup(const std::string& name){
+    KeyTable& table = Keys();
+    std::shared_lock<std::shared_mutex> lock(table.mutex);
+    auto it = table.ids.find(name);
+    return (it != table.ids.end()) ? it->second : -1;
+}
+
+
+Settings::Key Settings::Intern(const std::string& name){
+    Key key = Lookup(name);
+    if (key >= 0) return key;
+    KeyTable& table = Keys();
+    std::unique_lock<std::shared_mutex> lock(table.mutex);
+    auto it = table.ids.find(name);
+    if (it != table.ids.end()) return it->second;
+    key = table.names.size();
+    table.names.push_back(name);
+    table.ids[name] = key;
+    return key;
+}
+
+
+Settings::Value::Value(std::string value){
+
+    // Ignore the spaces before the value and before trailing comments
+    std::size_t first = value.find_first_not_of(" \t\r");
+    std::size_t last = value.find_last_not_of(" \t\r");
+    str = (first == std::string::npos) ? "" : value.substr(first, last - first + 1);
+    if (str.empty()) return;
+
+    // Typed values
+    const char* begin = str.c_str();
+    char* end;
+    double number = std::strtod(begin, &end);
+    if (*end == '\0'){
+        is_number = true;
+        d = number;
+    }
+    long integer = std::strtol(begin, &end, 10);
+    if (*end == '\0'){
+        is_int = true;
+        i = integer;
+    }
+    b = (str == "true");
+}
+
+
+void Settings::read(){
+    m_log.info(("Reading settings file from " + m_filename).c_str());
+
+    // Settings already set take precedence, as do earlier lines of the file
+    auto snapshot = std::make_shared<Snapshot>();
+    if (m_snapshot) *snapshot = *m_snapshot;
+    auto set = [&snapshot](Key key, std::shared_ptr<const Value> value){
+        if (key >= (Key) snapshot->size()) snapshot->resize(key + 1);
+        (*snapshot)[key] = value;
+    };
+    if (m_overlay){
+        for (auto& entry: *m_overlay) set(entry.first, entry.second);
+    }
+
+    std::ifstream infile; infile.open(m_filename);
+    std::string line;
+    while (std::getline(infile, line)){
+        line = line.substr(0, line.find("*")); // ignore comments in the config file
+        if (line.empty()) continue;
+        std::string delimiter = " ";
+        std::string var = line.substr(0, line.find(delimiter));
+        std::string val = (line.find(delimiter) == std::string::npos) ? "" : line.substr(line.find(delimiter) + 1, line.size());
+        if (var.empty()) continue;
+        Key key = Intern(var);
+        if (key < (Key) snapshot->size() && (*snapshot)[key]) continue;
+        set(key, std::make_shared<const Value>(val));
+    }
+    infile.close();
+
+    m_snapshot = snapshot;
+    m_overlay = nullptr;
+    return;
+}
+
+
+void Settings::update_value(std::string key, std::string value){
+    Key id = Intern(key);
+    auto overlay = m_overlay ? std::make_shared<Overlay>(*m_overlay) : std::make_shared<Overlay>();
+    auto entry = std::make_shared<const Value>(value);
+    auto it = std::lower_bound(overlay->begin(), overlay->end(), id, [](const std::pair<Key, std::shared_ptr<const Value>>& e, Key k){ return e.first < k; });
+    if (it != overlay->end() && it->first == id) it->second = entry;
+    else overlay->insert(it, {id, entry});
+    m_overlay = overlay;
+    return;
+}
+
+
+std::map<std::string, std::string> Settings::get_map() const {
+    std::map<std::string, std::string> map;
+    KeyTable& table = Keys();
+    std::shared_lock<std::shared_mutex> lock(table.mutex);
+    for (Key key=0; key < (Key) table.names.size(); key++){
+        const Value* v = Find(key);
+        if (v) map[table.names[key]] = v->str;
+    }
+    return map;
+}
@@ -0,0 +1,154 @@
+#include "SimultaneousNLL.hpp"
+#include "Log.hpp"
+
+#include "RooGlobalFunc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+namespace {
+
+    /**
+     * Evaluate a category NLL and time it
+     * @param nll category NLL
+     * @param cost evaluation time (seconds)
+    */
+    double EvaluateCategory(RooAbsReal* nll, double& cost){
+        auto start = std::chrono::steady_clock::now();
+        double value = nll->getVal();
+        cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return value;
+    }
+
+}
+
+
+SimultaneousNLL::SimultaneousNLL(const char* name, RooSimultaneous& pdf, RooAbsData& data, std::string cat_name, std::vector<std::string> labels, int nworkers)
+    : RooAbsReal(name, ""), m_nlls("nlls", "category NLLs", this), m_labels(labels) {
+
+    // One extended NLL per category
+    m_data = std::make_shared<std::vector<std::unique_ptr<RooAbsData>>>();
+    m_owned_nlls = std::make_shared<std::vector<std::unique_ptr<RooAbsReal>>>();
+    for (auto label: m_labels){
+        RooAbsData* cat_data = data.reduce(("(" + cat_name + "==" + cat_name + "::" + label + ")").c_str());
+        RooAbsReal* nll = pdf.getPdf(label.c_str())->createNLL(*cat_data, RooFit::Extended(true));
+        m_data->emplace_back(cat_data);
+        m_owned_nlls->emplace_back(nll);
+        m_nlls.add(*nll);
+    }
+
+    // Parameters shared by the category NLLs, constant or not
+    std::unique_ptr<RooArgSet> params(getParameters(RooArgSet()));
+    for (auto p: *params){
+        if (auto var = dynamic_cast<RooRealVar*>(p)) m_params.push_back(var);
+    }
+
+    m_partial = std::make_shared<std::vector<double>>(m_labels.size(), 0.);
+    m_costs = std::make_shared<std::vector<double>>(m_labels.size(), 0.);
+    m_total_costs = std::make_shared<std::vector<double>>(m_labels.size(), 0.);
+    m_nevals = std::make_shared<long>(0);
+    if (nworkers <= 1) return;
+
+    // Workers, forked now the model is built. A request holds the evaluation
+    // number, one category and the parameter values and constant flags; the
+    // reply holds the category, its NLL and its evaluation time. Each worker
+    // runs the constant-term optimisation of its own copy of the NLLs, and
+    // keeps it up to date when parameters are fixed, released or moved while
+    // constant (e.g. between fit stages).
+    std::vector<RooAbsReal*> nlls;
+    for (auto& nll: *m_owned_nlls) nlls.push_back(nll.get());
+    std::vector<RooRealVar*> vars = m_params;
+    auto last_eval = std::make_shared<double>(-1);
+    auto constants = std::make_shared<std::vector<bool>>();
+    m_workers = std::make_shared<ProcessPool::Workers>(std::min(nworkers, (int) m_labels.size()), [nlls, vars, last_eval, constants](const std::vector<double>& request){
+        const unsigned int nvars = vars.size();
+        if (request[0] != *last_eval){
+            bool first = constants->empty();
+            bool config_change = false, value_change = false;
+            if (first) constants->resize(nvars);
+            for (unsigned int k=0; k<nvars; k++){
+                bool constant = request[2 + nvars + k] != 0;
+                double value = request[2 + k];
+                if (!first && constant != (*constants)[k]) config_change = true;
+                else if (!first && constant && value != vars[k]->getVal()) value_change = true;
+                vars[k]->setConstant(constant);
+                vars[k]->setVal(value);
+                (*constants)[k] = constant;
+            }
+            for (auto nll: nlls){
+                if (first) nll->constOptimizeTestStatistic(RooAbsArg::Activate, true);
+                else if (config_change) nll->constOptimizeTestStatistic(RooAbsArg::ConfigChange, true);
+                else if (value_change) nll->constOptimizeTestStatistic(RooAbsArg::ValueChange, true);
+            }
+            *last_eval = request[0];
+        }
+        double cost;
+        double value = EvaluateCategory(nlls[(int) request[1]], cost);
+        return std::vector<double>{request[1], value, cost};
+    });
+}
+
+
+SimultaneousNLL::SimultaneousNLL(const SimultaneousNLL& other, const char* name)
+    : RooAbsReal(other, name), m_nlls("nlls", this, other.m_nlls), m_data(other.m_data), m_owned_nlls(other.m_owned_nlls),
+      m_labels(other.m_labels), m_params(other.m_params), m_workers(other.m_workers), m_partial(other.m_partial), m_costs(other.m_costs), m_total_costs(other.m_total_costs), m_nevals(other.m_nevals) {}
+
+
+double SimultaneousNLL::evaluate() const {
+    const unsigned int ncats = m_labels.size();
+    std::vector<double> costs(ncats, 0.);
+
+    // In this process, also in processes forked later (e.g. toys), which can't share the workers
+    if (!m_workers || !m_workers->Owner()){
+        for (unsigned int i=0; i<ncats; i++) (*m_partial)[i] = EvaluateCategory(static_cast<RooAbsReal*>(m_nlls.at(i)), costs[i]);
+    }
+    else{
+
+        // Shared queue of the categories, longest first; each worker takes
+        // the next one as soon as it has replied
+        std::vector<int> order(ncats);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b){ return (*m_costs)[a] > (*m_costs)[b]; });
+        std::vector<double> request(2 + 2 * m_params.size());
+        request[0] = *m_nevals;
+        for (unsigned int k=0; k<m_params.size(); k++){
+            request[2 + k] = m_params[k]->getVal();
+            request[2 + m_params.size() + k] = m_params[k]->isConstant();
+        }
+        unsigned int next = 0, pending = 0;
+        for (int w=0; w<m_workers->Size() && next<ncats; w++, pending++){
+            request[1] = order[next++];
+            m_workers->Send(w, request);
+        }
+        while (pending > 0){
+            std::vector<double> reply;
+            int w = m_workers->ReceiveAny(reply);
+            pending--;
+            if (reply.size() != 3 || reply[0] < 0 || reply[0] >= ncats){
+                Log("SimultaneousNLL").error("Unexpected reply from NLL worker " + std::to_string(w));
+                exit(1);
+            }
+            (*m_partial)[(int) reply[0]] = reply[1];
+            costs[(int) reply[0]] = reply[2];
+            if (next < ncats){
+                request[1] = order[next++];
+                m_workers->Send(w, request);
+                pending++;
+            }
+        }
+    }
+    for (unsigned int i=0; i<ncats; i++) (*m_total_costs)[i] += costs[i];
+    *m_costs = costs;
+    *m_nevals += 1;
+
+    // Compensated sum in category order
+    double sum = 0, compensation = 0;
+    for (double p: *m_partial){
+        double y = p - compensation;
+        double t = sum + y;
+        compensation = (t - sum) - y;
+        sum = t;
+    }
+    return sum;
+}
@@ -0,0 +1,123 @@
+#include "SystematicsRunner.hpp"
+#include "EfficiencyUtils.hpp"
+#include "FitResultUtils.hpp"
+#include "ProcessPool.hpp"
+#include "TextFileUtils.hpp"
+
+#include "RooFitResult.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+std::vector<SystematicsRunner::Variation> SystematicsRunner::ReadVariations(const RooArgSet& pars){
+    std::vector<Variation> variations;
+    std::ifstream infile(m_settings.get("systematics_file"));
+    std::string line;
+    while (std::getline(infile, line)){
+        line = line.substr(0, line.find("*"));
+        std::stringstream ss(line);
+        std::string name, par, value;
+        if (!(ss >> name >> par >> value)) continue;
+
+        // Lines with the same name make one variation
+        auto it = std::find_if(variations.begin(), variations.end(), [&](const Variation& v){ return v.name == name; });
+        if (it == variations.end()){
+            variations.push_back({name, {}});
+            it = variations.end() - 1;
+        }
+
+        if (par == "unfolding") AddUnfolding(*it, value);
+        else{
+            RooRealVar* var = dynamic_cast<RooRealVar*>(pars.find(par.c_str()));
+            if (!var){
+                m_log.warning(("Variation " + name + ": can't find the parameter " + par).c_str());
+                continue;
+            }
+            char* end = nullptr;
+            double number = std::strtod(value.c_str(), &end);
+            if (end == value.c_str() || *end != '\0'){
+                m_log.error(("Variation " + name + ": " + value + " is not a number, in the line \"" + line + "\"").c_str());
+                exit(1);
+            }
+            if (!var->isConstant()) m_log.warning(("Variation " + name + ": " + par + " is floating, it will only set the starting value").c_str());
+            it->changes.push_back({var, number});
+        }
+    }
+    return variations;
+}
+
+
+void SystematicsRunner::AddUnfolding(Variation& variation, std::string ender){
+    Settings s = m_settings;
+    s.update_value("unfolding_systematic", "true");
+    s.update_value("systematic_file_ender", ender);
+    for (auto bin: Definitions::DP_BINS){
+        TMatrixD unfolding = EfficiencyUtils::GetUnfoldingMatrix(abs(bin), s);
+        auto& elements = m_vars->unfolding_matrices[bin];
+        for (int i=0; i<EfficiencyUtils::nprods; i++){
+            for (int j=0; j<EfficiencyUtils::nprods; j++) variation.changes.push_back({elements[i][j], unfolding(i, j)});
+        }
+    }
+    return;
+}
+
+
+void SystematicsRunner::Run(){
+
+    // Nominal state
+    std::unique_ptr<RooArgSet> pars(m_pdf->getParameters(*m_dt->data));
+    std::unique_ptr<RooArgSet> nominal((RooArgSet*) pars->snapshot());
+    std::vector<RooRealVar*> floating;
+    for (auto arg: *pars){
+        RooRealVar* p = dynamic_cast<RooRealVar*>(arg);
+        if (p && !p->isConstant()) floating.push_back(p);
+    }
+
+    // Variations
+    std::vector<Variation> variations = ReadVariations(*pars);
+    int nworkers = 1;
+    if (m_settings.key_exists("systematics_workers")) nworkers = m_settings.getI("systematics_workers");
+    m_log.info(("Running " + std::to_string(variations.size()) + " systematic variations on " + std::to_string(nworkers) + " workers").c_str());
+
+    // Each worker restores the nominal minimum, changes the constants and refits
+    auto results = ProcessPool::Map(variations.size(), nworkers, [&](int i){
+        FitResultUtils::RestoreParameters(*pars, *nominal);
+        for (auto change: variations[i].changes) change.first->setVal(change.second);
+        std::unique_ptr<RooFitResult> r(m_pdf->fitTo(*m_dt->FitData(), RooFit::Save(1), RooFit::Extended(1), RooFit::PrintLevel(-1)));
+        std::vector<double> out = {(double) r->status()};
+        for (auto p: floating){
+            out.push_back(p->getVal());
+            out.push_back(p->getError());
+        }
+        return out;
+    });
+
+    // Output
+    std::string outfile_name = TextFileUtils::OutputPrefix(m_settings) + "systematics.txt";
+    m_log.info("Writing systematic shifts to " + outfile_name);
+    std::ofstream outfile(outfile_name);
+
+    outfile << "* Nominal\n";
+    for (auto p: floating) outfile << p->GetName() << " " << p->getVal() << " " << p->getError() << std::endl;
+    outfile << "\n* variation status parameter value error shift\n";
+    for (unsigned int i=0; i<variations.size(); i++){
+        if (results[i].size() != 1 + 2*floating.size()){
+            m_log.warning(("Variation " + variations[i].name + " failed").c_str());
+            continue;
+        }
+        for (unsigned int k=0; k<floating.size(); k++){
+            double value = results[i][1 + 2*k];
+            double error = results[i][2 + 2*k];
+            outfile << variations[i].name << " " << (int) results[i][0] << " " << floating[k]->GetName() << " "
+            << value << " " << error << " " << value - floating[k]->getVal() << std::endl;
+        }
+    }
+    outfile.close();
+
+    // Back to the nominal state
+    FitResultUtils::RestoreParameters(*pars, *nominal);
+    return;
+}
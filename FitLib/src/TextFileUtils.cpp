@@ -1,6 +1,8 @@
 
 #include "TextFileUtils.hpp"
 
+#include <sstream>
+
 namespace TextFileUtils {
 
     std::vector<std::string> ReadList(std::string filename){
@@ -12,4 +14,27 @@ namespace TextFileUtils {
         return lines;
     }
 
+
+    std::vector<std::string> SplitList(std::string value){
+        std::vector<std::string> entries;
+        std::stringstream ss(value);
+        std::string entry;
+        while (std::getline(ss, entry, ',')){
+            entry.erase(0, entry.find_first_not_of(" \t"));
+            entry.erase(entry.find_last_not_of(" \t") + 1);
+            if (!entry.empty()) entries.push_back(entry);
+        }
+        return entries;
+    }
+
+
+
+    std::string OutputPrefix(Settings settings){
+        std::string prename = "";
+        std::string outdir = "output/" + settings.get("tag") + "/" + settings.get("prod");
+        if (settings.key_exists("prename")) prename = settings.get("prename");
+        if (settings.key_exists("outdir")) outdir = settings.get("outdir");
+        return outdir + "/" + prename;
+    }
+
 }
@@ -0,0 +1,106 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+ThreadPool::ThreadPool(int nthreads){
+    if (nthreads < 1) nthreads = 1;
+    for (int i=0; i<nthreads; i++) m_queues.push_back(std::make_unique<Queue>());
+    for (int i=0; i<nthreads; i++) m_workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for (auto& w: m_workers) w.join();
+}
+
+
+void ThreadPool::Run(const std::vector<std::function<void()>>& tasks, const std::vector<double>& costs){
+    if (tasks.empty()) return;
+
+    // Longest tasks first, each one to the least loaded queue
+    std::vector<int> order(tasks.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (costs.size() == tasks.size()){
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b){ return costs[a] > costs[b]; });
+    }
+    std::vector<double> load(m_queues.size(), 0.);
+    for (int t: order){
+        int q = std::min_element(load.begin(), load.end()) - load.begin();
+        load[q] += (costs.size() == tasks.size()) ? costs[t] : 1.;
+        std::lock_guard<std::mutex> queue_lock(m_queues[q]->mutex);
+        m_queues[q]->tasks.push_back(t);
+    }
+
+    // Start the workers and wait until the batch is done
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_tasks = &tasks;
+    m_remaining = tasks.size();
+    m_error = nullptr;
+    m_generation += 1;
+    m_start.notify_all();
+    m_done.wait(lock, [&]{ return m_remaining == 0 && m_active == 0; });
+    m_tasks = nullptr;
+    if (m_error) std::rethrow_exception(m_error);
+    return;
+}
+
+
+void ThreadPool::WorkerLoop(int id){
+    unsigned long seen = 0;
+    while (true){
+        const std::vector<std::function<void()>>* tasks;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [&]{ return m_stop || m_generation != seen; });
+            if (m_stop) return;
+            seen = m_generation;
+            tasks = m_tasks;
+            m_active += 1;
+        }
+        int task;
+        while (tasks && PopTask(id, task)){
+            try { (*tasks)[task](); }
+            catch (...){
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_error) m_error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_remaining -= 1;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_active -= 1;
+        if (m_remaining == 0 && m_active == 0) m_done.notify_all();
+    }
+}
+
+
+bool ThreadPool::PopTask(int id, int& task){
+
+    // Own queue, from the front
+    {
+        std::lock_guard<std::mutex> lock(m_queues[id]->mutex);
+        if (!m_queues[id]->tasks.empty()){
+            task = m_queues[id]->tasks.front();
+            m_queues[id]->tasks.pop_front();
+            return true;
+        }
+    }
+
+    // Steal from the back of the other queues
+    for (unsigned int i=1; i<m_queues.size(); i++){
+        auto& victim = m_queues[(id + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (!victim->tasks.empty()){
+            task = victim->tasks.back();
+            victim->tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
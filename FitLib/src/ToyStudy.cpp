@@ -0,0 +1,115 @@
+#include "ToyStudy.hpp"
+#include "ProcessPool.hpp"
+#include "TextFileUtils.hpp"
+
+#include "RooDataSet.h"
+#include "RooFitResult.h"
+#include "RooRandom.h"
+#include "RooRealVar.h"
+#include "TFile.h"
+#include "TTree.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+void ToyStudy::Run(){
+
+    // Toy configuration
+    int ntoys = m_settings.getI("ntoys");
+    int nworkers = 1;
+    int seed = 1;
+    if (m_settings.key_exists("toy_workers")) nworkers = m_settings.getI("toy_workers");
+    if (m_settings.key_exists("toy_seed")) seed = m_settings.getI("toy_seed");
+    nworkers = std::max(1, std::min(nworkers, ntoys));
+    m_log.info(("Running " + std::to_string(ntoys) + " toys on " + std::to_string(nworkers) + " workers").c_str());
+
+    // Floating parameters and their generation values
+    std::unique_ptr<RooArgSet> pars(m_pdf->getParameters(m_observables));
+    std::vector<RooRealVar*> floating;
+    for (auto arg: *pars){
+        RooRealVar* p = dynamic_cast<RooRealVar*>(arg);
+        if (p && !p->isConstant()) floating.push_back(p);
+    }
+    std::vector<double> truth, truth_errors;
+    for (auto p: floating){
+        truth.push_back(p->getVal());
+        truth_errors.push_back(p->getError());
+    }
+
+    // Toy i is done by worker i % nworkers
+    // Per toy: status, covQual, minNLL, then value and error of each parameter
+    const unsigned int nvalues = 3 + 2 * floating.size();
+    auto results = ProcessPool::Map(nworkers, nworkers, [&](int w){
+        std::vector<double> out;
+        for (int i=w; i<ntoys; i+=nworkers){
+            for (unsigned int p=0; p<floating.size(); p++){
+                floating[p]->setVal(truth[p]);
+                floating[p]->setError(truth_errors[p]);
+            }
+            RooRandom::randomGenerator()->SetSeed(seed + i);
+            std::unique_ptr<RooDataSet> toy(m_pdf->generate(m_observables, RooFit::Extended(true)));
+            std::unique_ptr<RooFitResult> r(m_pdf->fitTo(*toy, RooFit::Save(1), RooFit::Extended(1), RooFit::PrintLevel(-1)));
+            out.insert(out.end(), {(double) r->status(), (double) r->covQual(), r->minNll()});
+            for (auto p: floating){
+                out.push_back(p->getVal());
+                out.push_back(p->getError());
+            }
+        }
+        return out;
+    });
+
+    // Output
+    std::string outfile_name = TextFileUtils::OutputPrefix(m_settings) + "toys.root";
+    m_log.info("Writing toy results to " + outfile_name);
+    TFile file(outfile_name.c_str(), "RECREATE");
+
+    TTree* tree = new TTree("toys", "");
+    int toy_index, toy_seed, status, cov_qual;
+    double nll;
+    std::vector<double> values(floating.size()), errors(floating.size()), residuals(floating.size()), pulls(floating.size());
+    tree->Branch("toy", &toy_index);
+    tree->Branch("seed", &toy_seed);
+    tree->Branch("status", &status);
+    tree->Branch("covQual", &cov_qual);
+    tree->Branch("minNLL", &nll);
+    for (unsigned int p=0; p<floating.size(); p++){
+        TString name = floating[p]->GetName();
+        tree->Branch(name, &values[p]);
+        tree->Branch(name + "_err", &errors[p]);
+        tree->Branch(name + "_res", &residuals[p]);
+        tree->Branch(name + "_pull", &pulls[p]);
+    }
+
+    int nfitted = 0;
+    for (int w=0; w<nworkers; w++){
+        unsigned int k = 0;
+        for (int i=w; i<ntoys && k + nvalues <= results[w].size(); i+=nworkers, k+=nvalues){
+            const double* v = &results[w][k];
+            toy_index = i;
+            toy_seed = seed + i;
+            status = v[0];
+            cov_qual = v[1];
+            nll = v[2];
+            for (unsigned int p=0; p<floating.size(); p++){
+                values[p] = v[3 + 2*p];
+                errors[p] = v[4 + 2*p];
+                residuals[p] = values[p] - truth[p];
+                pulls[p] = (errors[p] > 0) ? residuals[p] / errors[p] : 0;
+            }
+            tree->Fill();
+            nfitted += 1;
+        }
+    }
+    if (nfitted != ntoys) m_log.warning((std::to_string(ntoys - nfitted) + " toys failed").c_str());
+
+    tree->Write();
+    file.Close();
+
+    // Back to the generation values
+    for (unsigned int p=0; p<floating.size(); p++){
+        floating[p]->setVal(truth[p]);
+        floating[p]->setError(truth_errors[p]);
+    }
+    return;
+}
@@ -7,7 +7,9 @@ void Variables::FloatingYi(){
     for (auto prod: Definitions::PRODS){            
         unsigned int bin_counter=0;
         for (auto bin: Definitions::DP_BINS){
-            Yi[prod][bin] = new RooRealVar(("Y_" + prod + "_" + std::to_string(bin)).c_str(), "", Inputs::Ki[-1*bin], 0, 2*Inputs::Ki[-1*bin]+0.05);
+            RooRealVar* Y = new RooRealVar(("Y_" + prod + "_" + std::to_string(bin)).c_str(), "", Inputs::Ki[-1*bin], 0, 2*Inputs::Ki[-1*bin]+0.05);
+            registry.Register(Y, ParameterRegistry::Nuisance);
+            Yi[prod][bin] = Y;
         }
     }
     return;
@@ -49,7 +51,9 @@ void Variables::DefaultYi(){
 void Variables::FloatingByC(){
     for (auto C: {-1, 1}){
         for (auto bin: Definitions::DP_BINS){
-            Yi[std::to_string(C)][bin] = new RooRealVar(("Y_" + std::to_string(bin) + "_C_" + std::to_string(C)).c_str(), "", Inputs::Ki[-1*bin], 0, 2*Inputs::Ki[-1*bin]+0.05);
+            RooRealVar* Y = new RooRealVar(("Y_" + std::to_string(bin) + "_C_" + std::to_string(C)).c_str(), "", Inputs::Ki[-1*bin], 0, 2*Inputs::Ki[-1*bin]+0.05);
+            registry.Register(Y, ParameterRegistry::Nuisance);
+            Yi[std::to_string(C)][bin] = Y;
         }
     }
     return;
@@ -79,13 +83,13 @@ void Variables::InitialiseNi(){
     auto total_Ni = TotalNi();
 
     // Migrate the Ni
-    auto migration = EfficiencyUtils::GetMigrationMatrix(); // TMatrix
-    auto cpp_migration = MatrixMaths::ConvertTMatrix(migration, "migration"); // vector of vectors
+    auto migration = EfficiencyUtils::GetMigrationMatrix(m_settings); // TMatrix
+    migration_matrix = MatrixMaths::ConvertTMatrix(migration, "migration"); // vector of vectors
     std::map<TString, std::map<int, RooFormulaVar*>> migrated_Ni;
     for (auto prod: Definitions::PRODS){
         // Migrate the Ni
         // Returns map of RooFormulaVar
-        migrated_Ni[prod] = MatrixMaths::MatrixMultiplication( total_Ni[prod], cpp_migration, "Migrated_" + prod );
+        migrated_Ni[prod] = MatrixMaths::MatrixMultiplication( total_Ni[prod], migration_matrix, "Migrated_" + prod );
     }
 
     // Perform the efficiency correction
@@ -95,11 +99,30 @@ void Variables::InitialiseNi(){
             tmp_yield_by_prod.push_back( migrated_Ni[prod][bin] ); // Convert to vectors
         }
         auto tmp_unfolding = EfficiencyUtils::GetUnfoldingMatrix(abs(bin), m_settings); // Get unfolding matrix for bin
-        auto cpp_tmp_unfolding = MatrixMaths::ConvertTMatrix(tmp_unfolding, "unfolding_bin" + std::to_string(bin)); // Vector of vectors
-        auto tmp_unfolded_yield_in_bin = MatrixMaths::MatrixMultiplication( tmp_yield_by_prod, cpp_tmp_unfolding, "unfolded_bin_" + std::to_string(bin) ); // Do unfolding
+        unfolding_matrices[bin] = MatrixMaths::ConvertTMatrix(tmp_unfolding, "unfolding_bin" + std::to_string(bin)); // Vector of vectors
+        auto tmp_unfolded_yield_in_bin = MatrixMaths::MatrixMultiplication( tmp_yield_by_prod, unfolding_matrices[bin], "unfolded_bin_" + std::to_string(bin) ); // Do unfolding
         for (auto prod: Definitions::PRODS){
             Ni[prod][bin] = tmp_unfolded_yield_in_bin[prod]; // Get efficiency corrected Ni
         }
     }
     return;
 }
+
+
+void Variables::SetMigrationMatrix(const TMatrixD& migration){
+    for (unsigned int k=0; k<migration_matrix.size(); k++){
+        for (unsigned int l=0; l<migration_matrix[k].size(); l++) migration_matrix[k][l]->setVal(migration(k, l));
+    }
+    return;
+}
+
+
+void Variables::SetUnfoldingMatrix(int bin, const TMatrixD& unfolding){
+    for (int b: {-1*abs(bin), abs(bin)}){
+        if (unfolding_matrices.find(b) == unfolding_matrices.end()) continue;
+        for (int i=0; i<EfficiencyUtils::nprods; i++){
+            for (int j=0; j<EfficiencyUtils::nprods; j++) unfolding_matrices[b][i][j]->setVal(unfolding(i, j));
+        }
+    }
+    return;
+}
@@ -0,0 +1,128 @@
+#include "YieldModel.hpp"
+#include "Definitions.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+YieldModel::YieldModel(Variables* vars){
+    m_vars = vars;
+    m_log = Log("YieldModel");
+    m_pars.add(*m_vars->rCosDelta);
+    m_pars.add(*m_vars->rSinDelta);
+    for (auto prod: Definitions::PRODS) m_pars.add(*m_vars->integrated_N[prod]);
+    m_yields.resize(nprods*nbins);
+    m_jacobian.resize(nprods*nbins*NumParameters());
+    Update();
+}
+
+
+void YieldModel::Update(){
+
+    // Hadronic parameters and mixing
+    for (int b=0; b<nbins; b++){
+        int bin = Definitions::DP_BINS[b];
+        m_K[b] = m_vars->Ki_vars[bin]->getVal();
+        m_Kbar[b] = m_vars->Ki_vars[-1*bin]->getVal();
+        m_c[b] = m_vars->ci_vars[bin]->getVal();
+        m_s[b] = m_vars->si_vars[bin]->getVal();
+    }
+    m_xD = m_vars->xD->getVal();
+    m_yD = m_vars->yD->getVal();
+    m_C[0] = m_vars->C_vars["ODD"]->getVal();
+    m_C[1] = m_vars->C_vars["EVEN"]->getVal();
+    for (int p=0; p<nprods; p++) m_prod_C[p] = (Definitions::C_VALS[Definitions::PRODS[p]] == -1) ? 0 : 1;
+
+    // Migration and unfolding matrices
+    for (int k=0; k<nbins; k++){
+        for (int l=0; l<nbins; l++) m_migration(k, l) = m_vars->migration_matrix[k][l]->getVal();
+    }
+    for (int b=0; b<nbins; b++){
+        auto& unfolding = m_vars->unfolding_matrices[Definitions::DP_BINS[b]];
+        for (int k=0; k<nprods; k++){
+            for (int l=0; l<nprods; l++) m_unfolding[b](k, l) = unfolding[k][l]->getVal();
+        }
+    }
+    return;
+}
+
+
+void YieldModel::Evaluate(const double* x){
+    const int npars = NumParameters();
+    double rcos = x[0];
+    double rsin = x[1];
+    double r2 = rcos*rcos + rsin*rsin;
+
+    // Normalised Yi for each C and their derivatives w.r.t. rCosDelta and rSinDelta
+    EfficiencyUtils::BinVector Y[2], dYdx[2], dYdy[2];
+    for (int ci=0; ci<2; ci++){
+        double C = m_C[ci];
+        double U[nbins], dUdx[nbins], dUdy[nbins];
+        double S = 0, dSdx = 0, dSdy = 0;
+        for (int b=0; b<nbins; b++){
+            double K = m_K[b], Kbar = m_Kbar[b], c = m_c[b], s = m_s[b];
+            double sq = std::sqrt(K*Kbar);
+            U[b] = (Kbar + K*r2 + 2*C*sq*(c*rcos + s*rsin)) - (1+C)*m_yD*((1+r2)*c*sq + rcos*(Kbar + K)) - (1+C)*m_xD*((1-r2)*s*sq + rsin*(K - Kbar));
+            dUdx[b] = 2*K*rcos + 2*C*sq*c - (1+C)*m_yD*(2*rcos*c*sq + Kbar + K) + (1+C)*m_xD*2*rcos*s*sq;
+            dUdy[b] = 2*K*rsin + 2*C*sq*s - (1+C)*m_yD*2*rsin*c*sq - (1+C)*m_xD*(-2*rsin*s*sq + K - Kbar);
+            S += U[b];
+            dSdx += dUdx[b];
+            dSdy += dUdy[b];
+        }
+        for (int b=0; b<nbins; b++){
+            Y[ci](b) = U[b] / S;
+            dYdx[ci](b) = (dUdx[b] - Y[ci](b)*dSdx) / S;
+            dYdy[ci](b) = (dUdy[b] - Y[ci](b)*dSdy) / S;
+        }
+    }
+
+    // Migration, which is linear so it acts on the Yi directly
+    EfficiencyUtils::BinVector MY[2], MdYdx[2], MdYdy[2];
+    for (int ci=0; ci<2; ci++){
+        MY[ci] = m_migration * Y[ci];
+        MdYdx[ci] = m_migration * dYdx[ci];
+        MdYdy[ci] = m_migration * dYdy[ci];
+    }
+
+    // Unfolding between production mechanisms in each bin
+    std::fill(m_jacobian.begin(), m_jacobian.end(), 0.);
+    for (int b=0; b<nbins; b++){
+        for (int p=0; p<nprods; p++){
+            double* grad = &m_jacobian[(p*nbins + b)*npars];
+            double yield = 0;
+            for (int l=0; l<nprods; l++){
+                int ci = m_prod_C[l];
+                double u = m_unfolding[b](p, l);
+                double N = x[2+l];
+                yield += u * N * MY[ci](b);
+                grad[0] += u * N * MdYdx[ci](b);
+                grad[1] += u * N * MdYdy[ci](b);
+                grad[2+l] += u * MY[ci](b);
+            }
+            m_yields[p*nbins + b] = yield;
+        }
+    }
+    return;
+}
+
+
+void YieldModel::Evaluate(){
+    std::vector<double> x;
+    for (auto arg: m_pars) x.push_back(((RooAbsReal*) arg)->getVal());
+    Evaluate(x.data());
+    return;
+}
+
+
+double YieldModel::Validate(){
+    Update();
+    Evaluate();
+    double max_diff = 0;
+    for (int p=0; p<nprods; p++){
+        for (int b=0; b<nbins; b++){
+            double roofit = m_vars->Ni[Definitions::PRODS[p]][Definitions::DP_BINS[b]]->getVal();
+            double diff = std::abs(Yield(p, b) - roofit) / std::max(std::abs(roofit), 1e-12);
+            max_diff = std::max(max_diff, diff);
+        }
+    }
+    return max_diff;
+}
@@ -0,0 +1,185 @@
+#include "YieldNLL.hpp"
+#include "Definitions.hpp"
+
+#include "RooDataHist.h"
+#include "RooRealVar.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+YieldNLL::YieldNLL(BinnedFitModel* fm, Variables* vars, RooAbsData& data, YieldModel* yields, bool debug){
+    m_yields = yields;
+    m_log = Log("YieldNLL");
+
+    // Only the parameters of the yield graph can float
+    if (dynamic_cast<RooDataHist*>(&data)){
+        m_invalid = "the data are binned";
+        return;
+    }
+    if (vars->YiStrategy() != "default"){
+        m_invalid = "the closed-form yields only cover the default Yi strategy, not " + vars->YiStrategy();
+        return;
+    }
+    std::unique_ptr<RooArgSet> pars(fm->pdf->getParameters(data));
+    for (auto arg: *pars){
+        RooRealVar* p = dynamic_cast<RooRealVar*>(arg);
+        if (p && !p->isConstant() && !m_yields->Parameters().find(p->GetName())){
+            m_invalid = std::string(p->GetName()) + " is floating";
+            return;
+        }
+    }
+
+    // Cache the normalised component densities of each event
+    RooArgSet observables(*vars->m_kpi, *vars->m_tag);
+    double kpi_val = vars->m_kpi->getVal();
+    double tag_val = vars->m_tag->getVal();
+    for (unsigned int p=0; p<Definitions::PRODS.size(); p++){
+        for (unsigned int b=0; b<Definitions::DP_BINS.size(); b++){
+            std::string prod = Definitions::PRODS[p];
+            int bin = Definitions::DP_BINS[b];
+            Category cat;
+            cat.label = Definitions::ProdBinLabel(prod, bin);
+            cat.prod = p;
+            cat.bin = b;
+            FitModel* m = fm->category_models[cat.label];
+            RooAbsReal* signal_yield = m->components["signal"].yield;
+            if (signal_yield != vars->Ni[prod][bin]){
+                m_invalid = "the signal yield of " + cat.label + " is not given by the yield graph";
+                return;
+            }
+
+            std::unique_ptr<RooAbsData> cat_data(data.reduce((std::string(vars->cats->GetName()) + "==" + vars->cats->GetName() + "::" + cat.label).c_str()));
+            cat.nevents = cat_data->numEntries();
+            cat.ncomp = m->components.size();
+            cat.event_offset = m_weights.size();
+            cat.density_offset = m_densities.size();
+            for (unsigned int i=0; i<cat.nevents; i++){
+                cat_data->get(i);
+                m_weights.push_back(cat_data->weight());
+            }
+
+            for (auto c: m->components){
+                RooAbsReal* yield = c.second.yield;
+                if (yield == signal_yield){
+                    cat.constant.push_back(0);
+                    cat.rate.push_back(1);
+                }
+                else if (yield->dependsOn(*signal_yield)){
+                    // Fixed fraction of the signal yield
+                    cat.constant.push_back(0);
+                    cat.rate.push_back((signal_yield->getVal() != 0) ? yield->getVal() / signal_yield->getVal() : 0);
+                }
+                else{
+                    cat.constant.push_back(yield->getVal());
+                    cat.rate.push_back(0);
+                }
+                for (unsigned int i=0; i<cat.nevents; i++){
+                    observables.assignValueOnly(*cat_data->get(i));
+                    m_densities.push_back(c.second.shape->getVal(observables));
+                }
+            }
+            m_work.resize(std::max<std::size_t>(m_work.size(), cat.nevents));
+            m_categories.push_back(cat);
+        }
+    }
+    vars->m_kpi->setVal(kpi_val);
+    vars->m_tag->setVal(tag_val);
+
+    // The closed-form yields must reproduce the RooFit yield graph
+    double diff = m_yields->Validate();
+    if (diff > 1e-6){
+        m_invalid = "the closed-form yields differ from the RooFit yields by " + std::to_string(diff);
+        return;
+    }
+    if (debug){
+        m_log.debug(("Cached the component densities of " + std::to_string(m_categories.size()) + " categories").c_str());
+        m_log.debug(("Largest relative difference to the RooFit yields: " + std::to_string(diff)).c_str());
+    }
+}
+
+
+double YieldNLL::Compute(const double* x, double* grad) const {
+    const int npars = NDim();
+    m_yields->Evaluate(x);
+    if (grad) std::fill(grad, grad + npars, 0.);
+
+    double nll = 0;
+    double* density = m_work.data();
+    for (auto& cat: m_categories){
+        const unsigned int nev = cat.nevents;
+        const double* weights = m_weights.data() + cat.event_offset;
+        const double* f = m_densities.data() + cat.density_offset;
+        double signal = m_yields->Yield(cat.prod, cat.bin);
+
+        // Total density of each event
+        std::fill(density, density + nev, 0.);
+        for (unsigned int j=0; j<cat.ncomp; j++){
+            double n = cat.constant[j] + cat.rate[j] * signal;
+            const double* fj = f + j*nev;
+            nll += n;
+            for (unsigned int e=0; e<nev; e++) density[e] += n * fj[e];
+        }
+
+        // Log-likelihood, then w/density for the gradient
+        double sum_log[4] = {0, 0, 0, 0};
+        unsigned int e = 0;
+        for (; e + 4 <= nev; e += 4){
+            for (unsigned int l=0; l<4; l++) sum_log[l] += weights[e+l] * std::log(density[e+l]);
+        }
+        for (; e<nev; e++) sum_log[0] += weights[e] * std::log(density[e]);
+        nll -= (sum_log[0] + sum_log[1]) + (sum_log[2] + sum_log[3]);
+        if (!grad) continue;
+        for (e=0; e<nev; e++) density[e] = weights[e] / density[e];
+
+        // Chain rule through the signal yield of the category
+        double dnll_dsignal = 0;
+        for (unsigned int j=0; j<cat.ncomp; j++){
+            if (cat.rate[j] == 0) continue;
+            const double* fj = f + j*nev;
+            double sum_ratio[4] = {0, 0, 0, 0};
+            for (e=0; e + 4 <= nev; e += 4){
+                for (unsigned int l=0; l<4; l++) sum_ratio[l] += fj[e+l] * density[e+l];
+            }
+            for (; e<nev; e++) sum_ratio[0] += fj[e] * density[e];
+            dnll_dsignal += cat.rate[j] * (1 - ((sum_ratio[0] + sum_ratio[1]) + (sum_ratio[2] + sum_ratio[3])));
+        }
+        const double* dsignal = m_yields->Gradient(cat.prod, cat.bin);
+        for (int k=0; k<npars; k++) grad[k] += dnll_dsignal * dsignal[k];
+    }
+    return nll;
+}
+
+
+double YieldNLL::DoEval(const double* x) const {
+    m_nevals += 1;
+    return Compute(x, nullptr);
+}
+
+
+void YieldNLL::Gradient(const double* x, double* grad) const {
+    m_ngrads += 1;
+    Compute(x, grad);
+    m_last_x.assign(x, x + NDim());
+    m_last_grad.assign(grad, grad + NDim());
+    return;
+}
+
+
+double YieldNLL::DoDerivative(const double* x, unsigned int icoord) const {
+    if (m_last_x.size() != NDim() || !std::equal(m_last_x.begin(), m_last_x.end(), x)){
+        std::vector<double> grad(NDim());
+        Gradient(x, grad.data());
+    }
+    return m_last_grad[icoord];
+}
+
+
+void YieldNLL::FdF(const double* x, double& f, double* df) const {
+    m_nevals += 1;
+    m_ngrads += 1;
+    f = Compute(x, df);
+    m_last_x.assign(x, x + NDim());
+    m_last_grad.assign(df, df + NDim());
+    return;
+}
@@ -5,6 +5,7 @@
 #include "FitModel.hpp"
 #include "Fitter.hpp"
 #include "Plotter.hpp"
+#include "ToyStudy.hpp"
 
 /**
  * Function to print a welcome statement
@@ -65,6 +66,14 @@ int main(int argc , char* argv[]){
     ft->RunFit();
     ft->SaveOutput();
 
+    // ===================================
+    // Pseudo-experiments
+    // ===================================
+    if (set->key_exists("ntoys")){
+        ToyStudy* ts = new ToyStudy(*set, fm->pdf.get(), RooArgSet(*vars->m_kpi, *vars->m_tag), m_debug);
+        ts->Run();
+    }
+
     // ===================================
     // Plot the fit and scatter
     // ===================================
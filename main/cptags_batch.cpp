@@ -0,0 +1,129 @@
+#include "Settings.hpp"
+#include "Log.hpp"
+#include "Variables.hpp"
+#include "Data.hpp"
+#include "FitModel.hpp"
+#include "Fitter.hpp"
+#include "Plotter.hpp"
+#include "ProcessPool.hpp"
+#include "TextFileUtils.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+/**
+ * Configuration of the batch
+*/
+struct BatchConfig {
+    std::string filename;
+    Settings settings;
+    double cost = 0;
+};
+
+
+/**
+ * Key of the input sample of a configuration. Configurations with the
+ * same key read the same files with the same variable ranges and weights.
+ * @param s fit config
+*/
+std::string SampleKey(Settings s){
+    std::string key = s.get("tag") + " " + s.get("m_sig_low") + " " + s.get("m_sig_high") + " " + s.get("m_tag_low") + " " + s.get("m_tag_high") + " " + s.get("weight_mc");
+    if (s.key_exists("data_file")) key += " " + s.get("data_file");
+    return key;
+}
+
+
+/**
+ * Run the selection, fit and plots of one configuration, as cptags does
+ * @param s fit config
+ * @param sample Data class with the uncut samples
+*/
+void RunConfig(Settings s, Data* sample){
+    bool m_debug = s.getB("debug");
+    Log log("cptags_batch");
+    log.success("Fitting " + s.getT("tag") + " " + s.getT("prod"));
+
+    Variables* vars = new Variables(s);
+    Data* dt = new Data(s, vars, sample, m_debug);
+    FitModel* fm = new FitModel(s, vars, dt, m_debug);
+    fm->ReadComponents();
+    fm->MakePDF();
+
+    Fitter* ft = new Fitter(s, vars, fm, dt, m_debug);
+    ft->RunFit();
+    ft->SaveOutput();
+
+    Plotter* pt = new Plotter(s, vars, dt, fm, m_debug);
+    pt->Plot(false, false, s.getB("pulls"));
+    pt->Plot(false, true, s.getB("pulls"));
+    RooDataSet* toy_data = fm->pdf->generate(RooArgList(*vars->m_kpi, *vars->m_tag), 5 * dt->data->numEntries());
+    pt->ScatterPlot(*dt->data, false);
+    pt->ScatterPlot(*toy_data, true);
+    return;
+}
+
+
+int main(int argc , char* argv[]){
+
+    // ===================================
+    // Read the list of settings files
+    // ===================================
+    Log log("cptags_batch");
+    auto filenames = TextFileUtils::ReadList(argv[1]);
+    int nworkers = (argc > 2) ? std::stoi(argv[2]) : 4;
+
+    // ===================================
+    // Group the configurations by sample
+    // ===================================
+    std::map<std::string, std::vector<BatchConfig>> groups;
+    for (auto filename: filenames){
+        if (filename == "" || filename[0] == '*') continue;
+        Settings s(filename);
+        s.read();
+        if (s.get("tag") == "KSPiPi"){
+            log.warning("Skipping " + filename + ": use kspipi for the KSPiPi fit");
+            continue;
+        }
+        groups[SampleKey(s)].push_back({filename, s});
+    }
+
+    for (auto& group: groups){
+
+        // ===================================
+        // Load the sample once, without cuts
+        // ===================================
+        Settings sample_settings = group.second.front().settings;
+        sample_settings.update_value("sample_signal_mc", "false");
+        log.success("Loading sample for " + sample_settings.getT("tag") + " (" + std::to_string(group.second.size()) + " configurations)");
+        Variables* sample_vars = new Variables(sample_settings);
+        Data* sample = new Data(sample_settings, sample_vars, false, sample_settings.getB("debug"));
+
+        // ===================================
+        // Longest configurations first
+        // ===================================
+        for (auto& config: group.second){
+            TString cut = Selection::ProdCut(config.settings.getT("prod"), config.settings.getT("tag"));
+            if (Selection::TagCut(config.settings.getT("tag")) != "") cut += " & " + Selection::TagCut(config.settings.getT("tag"));
+            double n_components = TextFileUtils::ReadList(config.settings.get("components")).size();
+            config.cost = n_components * sample->data->sumEntries(cut) + sample->signal_mc->sumEntries(cut);
+        }
+        std::vector<int> order(group.second.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b){ return group.second[a].cost > group.second[b].cost; });
+
+        // ===================================
+        // Run the configurations in parallel
+        // ===================================
+        auto status = ProcessPool::Map(order.size(), nworkers, [&](int i){
+            RunConfig(group.second[order[i]].settings, sample);
+            return std::vector<double>{1.};
+        });
+        for (unsigned int i=0; i<order.size(); i++){
+            if (status[i].empty()) log.error("Failed: " + group.second[order[i]].filename);
+        }
+
+        delete sample;
+    }
+
+    return 0;
+}
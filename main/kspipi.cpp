@@ -4,6 +4,9 @@
 #include "Data.hpp"
 #include "BinnedFitModel.hpp"
 #include "BinnedFitter.hpp"
+#include "ProfileScanner.hpp"
+#include "SystematicsRunner.hpp"
+#include "ToyStudy.hpp"
 #include "Plotter.hpp"
 
 /**
@@ -65,18 +68,34 @@ int main(int argc , char* argv[]){
     ft->RunFit();
     ft->SaveOutput();
 
+    // ===================================
+    // Systematic variations
+    // ===================================
+    if (set->key_exists("systematics_file")){
+        SystematicsRunner* sr = new SystematicsRunner(*set, vars, fm->FitPdf(), dt, m_debug);
+        sr->Run();
+    }
+
+    // ===================================
+    // Profile likelihood scan
+    // ===================================
+    if (set->getB("scan")){
+        ProfileScanner* sc = new ProfileScanner(*set, vars, fm->FitPdf(), dt, m_debug);
+        sc->Run();
+    }
+
+    // ===================================
+    // Pseudo-experiments
+    // ===================================
+    if (set->key_exists("ntoys")){
+        ToyStudy* ts = new ToyStudy(*set, fm->pdf.get(), RooArgSet(*vars->m_kpi, *vars->m_tag, *vars->cats), m_debug);
+        ts->Run();
+    }
+
     // ===================================
     // Plot the fit and scatter
     // ===================================
     if (set->getB("plot")){
-        for (auto category: fm->category_models){
-            set->update_value("prename", category.first);
-            Plotter* pt = new Plotter(*set, vars, dt, category.second, m_debug);
-            pt->Plot(false, false, set->getB("pulls"), category.first);
-            pt->Plot(false, true, set->getB("pulls"), category.first);
-            //RooDataSet* toy_data = fm->pdf->generate(RooArgList(*vars->m_kpi, *vars->m_tag), 5 * dt->data->numEntries());
-            //pt->ScatterPlot(*dt->data, false);
-            //pt->ScatterPlot(*toy_data, true);
-        }
+        Plotter::PlotCategories(*set, vars, dt, fm->category_models, m_debug);
     }
 }
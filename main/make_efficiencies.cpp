@@ -0,0 +1,33 @@
+#include "Log.hpp"
+#include "MCMatrices.hpp"
+
+/**
+ * Compute the unfolding matrices of every tag, and of each DP region of
+ * KSPiPi, from the truth-tagged signal MC, and write them in the text
+ * format of the efficiency folders.
+ * Usage: make_efficiencies <output folder> <threads> <signal MC ROOT files...>
+*/
+int main(int argc , char* argv[]){
+
+    Log log("make_efficiencies");
+    if (argc < 4){
+        log.error("Usage: make_efficiencies <output folder> <threads> <signal MC ROOT files...>");
+        return 1;
+    }
+    std::string folder = argv[1];
+    int nthreads = std::stoi(argv[2]);
+    std::vector<std::string> files(argv + 3, argv + argc);
+    if (folder.back() != '/') folder += "/";
+
+    int nmatrices = 0;
+    for (auto tag: MCMatrices::TAGS){
+        auto counts = MCMatrices::CountUnfolding(files, tag, nthreads);
+        for (auto& entry: counts){
+            MCMatrices::WriteUnfoldingMatrix(folder + entry.first, MCMatrices::UnfoldingMatrix(entry.second).matrix);
+            nmatrices += 1;
+        }
+        log.success(("Computed the unfolding matrices of " + tag).c_str());
+    }
+    log.success(("Wrote " + std::to_string(nmatrices) + " matrices to " + folder).c_str());
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include "Log.hpp"
+#include "EfficiencyUtils.hpp"
+#include "EfficiencyBundle.hpp"
+
+#include <algorithm>
+#include <dirent.h>
+
+/**
+ * Pack the unfolding matrices of an efficiency folder and the migration
+ * matrix into one efficiency bundle, read with the efficiency_bundle setting.
+ * Usage: pack_efficiencies <bundle> <efficiency folder> [migration ROOT file]
+*/
+int main(int argc , char* argv[]){
+
+    Log log("pack_efficiencies");
+    if (argc < 3){
+        log.error("Usage: pack_efficiencies <bundle> <efficiency folder> [migration ROOT file]");
+        return 1;
+    }
+    std::string bundle_name = argv[1];
+    std::string folder = argv[2];
+    std::string migration_file = (argc > 3) ? argv[3] : EfficiencyUtils::migration_file;
+    if (folder.back() != '/') folder += "/";
+
+    // Unfolding matrices: every *_vs_KPi*.txt file of the folder
+    std::vector<std::string> names;
+    DIR* dir = opendir(folder.c_str());
+    if (!dir){
+        log.error("Can't open " + folder);
+        return 1;
+    }
+    for (dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)){
+        std::string name = entry->d_name;
+        if (name.find("_vs_KPi") == std::string::npos || name.size() < 4 || name.substr(name.size() - 4) != ".txt") continue;
+        names.push_back(name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    std::vector<std::pair<std::string, TMatrixD>> matrices;
+    for (auto name: names) matrices.push_back({name, EfficiencyUtils::ReadUnfoldingFile(folder + name)});
+
+    // Migration matrix
+    matrices.push_back({"migMatrix", EfficiencyUtils::ReadMigrationFile(migration_file)});
+
+    if (!EfficiencyBundle::Write(bundle_name, matrices, folder, migration_file)){
+        log.error("Can't write " + bundle_name);
+        return 1;
+    }
+    log.success(("Packed " + std::to_string(matrices.size()) + " matrices into " + bundle_name).c_str());
+    return 0;
+}